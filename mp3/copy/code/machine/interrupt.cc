@@ -23,6 +23,7 @@
 #include "copyright.h"
 #include "interrupt.h"
 #include "main.h"
+#include <limits.h>
 
 // String definitions for debugging messages
 
@@ -73,6 +74,7 @@ Interrupt::Interrupt()
 {
     level = IntOff;
     pending = new SortedList<PendingInterrupt *>(PendingCompare);
+    nextDue = INT_MAX;
     inHandler = FALSE;
     yieldOnReturn = FALSE;
     status = SystemMode;
@@ -143,6 +145,11 @@ Interrupt::SetLevel(IntStatus now)
 //	Two things can cause OneTick to be called:
 //		interrupts are re-enabled
 //		a user instruction is executed
+//
+//	Nearly always nothing is due yet, so we compare the clock against
+//	the cached deadline of the first pending interrupt, and only go
+//	through the interrupt path (turning interrupts off and on again,
+//	and checking the pending list) once it has been reached.
 //----------------------------------------------------------------------
 void
 Interrupt::OneTick()
@@ -158,8 +165,57 @@ Interrupt::OneTick()
 	stats->totalTicks += UserTick;
 	stats->userTicks += UserTick;
     }
+    if (stats->totalTicks < nextDue && !yieldOnReturn 
+				&& !debug->IsEnabled(dbgInt)) {
+	return;			// nothing to do yet
+    }
     DEBUG(dbgInt, "== Tick " << stats->totalTicks << " ==");
 
+    ServicePending(oldStatus);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::UserTicks
+// 	Advance simulated time by "count" user instructions at once, and
+//	check if there are any pending interrupts to be called.
+//
+//	Used by the threaded-code engine in the machine emulation, which
+//	runs a basic block at a time.  The caller guarantees that no
+//	interrupt fell due before the last of the "count" instructions
+//	(see NextDueTime), so this is the same as calling OneTick after
+//	each of them.
+//----------------------------------------------------------------------
+
+void
+Interrupt::UserTicks(int count)
+{
+    Statistics *stats = kernel->stats;
+
+    ASSERT(status == UserMode);
+    stats->totalTicks += count * UserTick;
+    stats->userTicks += count * UserTick;
+    if (stats->totalTicks < nextDue && !yieldOnReturn 
+				&& !debug->IsEnabled(dbgInt)) {
+	return;			// nothing to do yet
+    }
+    DEBUG(dbgInt, "== Tick " << stats->totalTicks << " ==");
+
+    ServicePending(status);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::ServicePending
+// 	Check if any pending interrupts are now ready to fire, and if
+//	one of their handlers asked for a context switch, do it.
+//	Called after simulated time has advanced.
+//
+//	"oldStatus" -- the machine status to go back to after the 
+//		context switch
+//----------------------------------------------------------------------
+
+void
+Interrupt::ServicePending(MachineStatus oldStatus)
+{
 // check any pending interrupts are now ready to fire
     ChangeLevel(IntOn, IntOff);	// first, turn off interrupts
 				// (interrupt handlers run with
@@ -304,6 +360,8 @@ Interrupt::Schedule(CallBackObj *toCall, int fromNow, IntType type)
     ASSERT(fromNow > 0);
 
     pending->Insert(toOccur);
+    if (when < nextDue)
+	nextDue = when;
 }
 
 //----------------------------------------------------------------------
@@ -361,6 +419,7 @@ Interrupt::CheckIfDue(bool advanceClock)
 	delete next;
     } while (!pending->IsEmpty() 
     		&& (pending->Front()->when <= stats->totalTicks));
+    nextDue = pending->IsEmpty() ? INT_MAX : pending->Front()->when;
     inHandler = FALSE;
     return TRUE;
 }
@@ -125,12 +125,20 @@ class Interrupt {
     				// by the hardware device simulators.
     
     void OneTick();       	// Advance simulated time
+    void UserTicks(int count);	// Advance simulated time by "count"
+				// user instructions at once
+    int NextDueTime() { return nextDue; }
+				// When the next pending interrupt is due
 
   private:
     IntStatus level;		// are interrupts enabled or disabled?
     SortedList<PendingInterrupt *> *pending;		
     				// the list of interrupts scheduled
 				// to occur in the future
+    int nextDue;		// when pending->Front() is due (or the 
+				// largest possible time, if nothing is 
+				// pending), cached so that advancing the
+				// clock can tell cheaply if anything fires
     //int writeFileNo;            //UNIX file emulating the display
     bool inHandler;		// TRUE if we are running an interrupt handler
     //bool putBusy;               // Is a PrintInt operation in progress
@@ -141,6 +149,9 @@ class Interrupt {
 
     // these functions are internal to the interrupt simulation code
 
+    void ServicePending(MachineStatus oldStatus);
+				// Fire any interrupts that are due, and
+				// context switch if one of them asked to
     bool CheckIfDue(bool advanceClock); 
     				// Check if any interrupts are supposed
 				// to occur now, and if so, do them
@@ -18,6 +18,36 @@ static char* exceptionNames[] = { "no exception", "syscall",
 				"bus error", "address error", "overflow",
 				"illegal instruction" };
 
+// The shape of physical memory (see machine.h).
+
+int PageSize = DefaultPageSize;
+int PageShift = 7;			// log2(DefaultPageSize)
+int NumPhysPages = DefaultNumPhysPages;
+int MemorySize = DefaultNumPhysPages * DefaultPageSize;
+
+//----------------------------------------------------------------------
+// SetMemorySize
+// 	Choose the page size and the amount of physical memory.  Must be
+//	called, if at all, before the Machine is created.
+//
+//	"pageSize" -- bytes per page; a power of two, and a whole number
+//		of words
+//	"numPhysPages" -- # of pages of physical memory
+//----------------------------------------------------------------------
+
+void
+SetMemorySize(int pageSize, int numPhysPages)
+{
+    ASSERT(pageSize >= 4 && (pageSize & (pageSize - 1)) == 0);
+    ASSERT(numPhysPages > 0);
+
+    PageSize = pageSize;
+    for (PageShift = 0; (1 << PageShift) < pageSize; PageShift++)
+	;
+    NumPhysPages = numPhysPages;
+    MemorySize = numPhysPages * pageSize;
+}
+
 //----------------------------------------------------------------------
 // CheckEndian
 // 	Check to be sure that the host really uses the format it says it 
@@ -50,9 +80,14 @@ void CheckEndian()
 //
 //	"debug" -- if TRUE, drop into the debugger after each user instruction
 //		is executed.
+//	"interpret" -- if TRUE, run user programs with the reference 
+//		interpreter only, one instruction at a time, rather than 
+//		with the (faster) threaded-code engine.
+//	"tlbEntries" -- if non-zero, translate addresses with a software-
+//		loaded TLB of this many entries instead of a page table.
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, bool interpret, int tlbEntries)
 {
     int i;
 
@@ -61,15 +96,34 @@ Machine::Machine(bool debug)
     mainMemory = new char[MemorySize];
     for (i = 0; i < MemorySize; i++)
       	mainMemory[i] = 0;
-#ifdef USE_TLB
-    tlb = new TranslationEntry[TLBSize];
-    for (i = 0; i < TLBSize; i++)
-	tlb[i].valid = FALSE;
-    pageTable = NULL;
-#else	// use linear page table
-    tlb = NULL;
+    decodeCache = new Instruction[MemorySize / 4];
+    decodeValid = new bool[MemorySize / 4];
+    for (i = 0; i < MemorySize / 4; i++)
+	decodeValid[i] = FALSE;
+    codePage = new bool[NumPhysPages];
+    for (i = 0; i < NumPhysPages; i++)
+	codePage[i] = FALSE;
+    threadedCode = new InstrHandler[MemorySize / 4];
+    blockLength = new int[MemorySize / 4];
+    for (i = 0; i < MemorySize / 4; i++)
+	blockLength[i] = 0;
+    inBlock = FALSE;
+    interpretOnly = interpret;
+    tlbSize = tlbEntries;
+    if (tlbSize > 0) {
+	tlb = new TranslationEntry[tlbSize];
+	tlbLastUse = new int[tlbSize];
+	for (i = 0; i < tlbSize; i++) {
+	    tlb[i].valid = FALSE;
+	    tlbLastUse[i] = 0;
+	}
+    } else {		// use linear page table
+	tlb = NULL;
+	tlbLastUse = NULL;
+    }
     pageTable = NULL;
-#endif
+
+    FlushTranslationCache();
 
     singleStep = debug;
     CheckEndian();
@@ -83,8 +137,15 @@ Machine::Machine(bool debug)
 Machine::~Machine()
 {
     delete [] mainMemory;
-    if (tlb != NULL)
+    delete [] decodeCache;
+    delete [] decodeValid;
+    delete [] codePage;
+    delete [] threadedCode;
+    delete [] blockLength;
+    if (tlb != NULL) {
         delete [] tlb;
+        delete [] tlbLastUse;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -101,6 +162,12 @@ void
 Machine::RaiseException(ExceptionType which, int badVAddr)
 {
     DEBUG(dbgMach, "Exception: " << exceptionNames[which]);
+    if (inBlock) {		// charge for the part of the block run so
+				// far, so the kernel sees the right time
+	inBlock = FALSE;
+	if (registers[PCReg] != blockStartPC)
+	    kernel->interrupt->UserTicks((registers[PCReg] - blockStartPC) / 4);
+    }
     registers[BadVAddrReg] = badVAddr;
     DelayedLoad(0, 0);			// finish anything in progress
     kernel->interrupt->setStatus(SystemMode);
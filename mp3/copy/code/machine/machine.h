@@ -26,19 +26,29 @@
 #include "translate.h"
 
 // Definitions related to the size, and format of user memory
+//
+// The page size and the number of pages of physical memory are chosen
+// when Nachos boots (see the -ps and -np flags in main.cc), by calling
+// SetMemorySize before the Machine is created.  They must not change
+// after that.
 
-const int PageSize = 128; 		// set the page size equal to
+const int DefaultPageSize = 128;	// set the page size equal to
 					// the disk sector size, for simplicity
+const int DefaultNumPhysPages = 128;
 
-//
-// You are allowed to change this value.
-// Doing so will change the number of pages of physical memory
-// available on the simulated machine.
-//
-const int NumPhysPages = 128;
+extern int PageSize;			// bytes per page, a power of two
+extern int PageShift;			// log2(PageSize)
+extern int NumPhysPages;		// # of pages of physical memory
+extern int MemorySize;			// NumPhysPages * PageSize
+
+extern void SetMemorySize(int pageSize, int numPhysPages);
+					// Set the values above
 
-const int MemorySize = (NumPhysPages * PageSize);
 const int TLBSize = 4;			// if there is a TLB, make it small
+					// (the default under -DUSE_TLB; the
+					// size can also be set with -tlb)
+const int TransCacheSize = 64;		// # of entries in the simulator's
+					// own cache of recent translations
 
 enum ExceptionType { NoException,           // Everything ok!
 		     SyscallException,      // A program executed a system call.
@@ -88,13 +98,61 @@ enum ExceptionType { NoException,           // Everything ok!
 // The procedures in this class are defined in machine.cc, mipssim.cc, and
 // translate.cc.
 
-class Instruction;
+// The following class defines an instruction, represented in both
+// 	undecoded binary form
+//      decoded to identify
+//	    operation to do
+//	    registers to act on
+//	    any immediate operand value
+//
+// The machine keeps a decoded copy of every word it has executed (see
+// Machine::FetchInstruction), so each instruction is only decoded once
+// for as long as its page of physical memory is left unmodified.
+
+class Instruction {
+  public:
+    void Decode();	// decode the binary representation of the instruction
+
+    unsigned int value; // binary representation of the instruction
+
+    char opCode;     // Type of instruction.  This is NOT the same as the
+    		     // opcode field from the instruction: see defs in mips.h
+    char rs, rt, rd; // Three registers from instruction.
+    int extra;       // Immediate or target or shamt field or offset.
+                     // Immediates are sign-extended.
+};
+
+class Machine;
+
+// A handler simulates one decoded instruction for the threaded-code
+// engine (see Machine::RunBlock).  It is passed the machine's registers
+// directly, and returns FALSE if the instruction trapped to the kernel.
+
+typedef bool (*InstrHandler)(Machine *machine, int *registers,
+				Instruction *instr);
+
+// The simulator keeps a small direct-mapped cache of the translations
+// it has recently made, indexed by virtual page number, so that most
+// loads, stores and instruction fetches can skip Machine::Translate.
+// This is not part of the simulated hardware -- the kernel never sees
+// it, except that it must be flushed whenever a translation changes.
+
+class TransCacheEntry {
+  public:
+    int virtualPage;	// the page this entry maps, or -1 if empty
+    char *page;		// where that page starts in mainMemory
+    bool writable;	// can the page be written without going through
+			// Translate?  Only set once the dirty bit is.
+};
+
 class Interrupt;
 
 class Machine {
   public:
-    Machine(bool debug);	// Initialize the simulation of the hardware
-				// for running user programs
+    Machine(bool debug, bool interpret, int tlbEntries);
+				// Initialize the simulation of the hardware
+				// for running user programs, with a TLB of
+				// "tlbEntries" entries (0 for a page table)
     ~Machine();			// De-allocate the data structures
 
 // Routines callable by the Nachos kernel
@@ -134,6 +192,10 @@ class Machine {
 
     TranslationEntry *tlb;		// this pointer should be considered 
 					// "read-only" to Nachos kernel code
+    int tlbSize;			// # of entries in the TLB, if any
+    int *tlbLastUse;			// when each TLB entry was last 
+					// referenced, counted in TLB hits; 
+					// lets the kernel replace LRU entries
 
     TranslationEntry *pageTable;
     unsigned int pageTableSize;
@@ -143,17 +205,55 @@ class Machine {
     				// Read or write 1, 2, or 4 bytes of virtual 
 				// memory (at addr).  Return FALSE if a 
 				// correct translation couldn't be found.
+
+    void InvalidateDecodedPage(int pageFrame);
+				// Discard the decoded instructions cached
+				// for a physical page.  The kernel must
+				// call this whenever it changes the
+				// contents of a page behind the machine's
+				// back (eg, loading a program into it).
+
+    void FlushTranslationCache();
+				// Forget every cached translation.  The
+				// kernel must call this whenever it
+				// switches page tables, or changes any
+				// page table or TLB entry (including
+				// clearing its use or dirty bit).
   private:
 
 // Routines internal to the machine simulation -- DO NOT call these directly
     void DelayedLoad(int nextReg, int nextVal);  	
 				// Do a pending delayed load (modifying a reg)
 
-    void OneInstruction(Instruction *instr); 	
-    				// Run one instruction of a user program.
+    void OneInstruction(); 	// Run one instruction of a user program.
+
+    bool ExecInstruction(Instruction *instr);
+				// Execute one decoded instruction; return
+				// FALSE if it trapped to the kernel.
+
+    void RunBlock();		// Run a basic block of a user program,
+				// using the threaded-code engine.
+    void TranslateBlock(int word);
+				// Build the basic block starting at a
+				// word of physical memory.
+    static bool InterpretHandler(Machine *machine, int *registers,
+				Instruction *instr);
+				// Threaded-code handler that falls back on
+				// ExecInstruction.
+
+    Instruction *FetchInstruction(int addr);
+				// Translate "addr" and return the decoded
+				// instruction stored there, decoding it
+				// only if it is not already cached.
+				// Returns NULL if an exception occurred.
     
 
 
+    char *CachedTranslate(int virtAddr, int size, bool writing);
+				// Look up an address in transCache; return
+				// where it is in mainMemory, or NULL if 
+				// Translate must be called instead.
+
     ExceptionType Translate(int virtAddr, int* physAddr, int size,bool writing);
     				// Translate an address, and check for 
 				// alignment.  Set the use and dirty bits in 
@@ -173,6 +273,26 @@ class Machine {
 
     int registers[NumTotalRegs]; // CPU registers, for executing user programs
 
+    Instruction *decodeCache;	// decoded copy of each word of mainMemory
+    bool *decodeValid;		// is the decodeCache entry for a word current?
+    bool *codePage;		// has any word of a physical page been
+				// decoded since it was last invalidated?
+
+    TransCacheEntry transCache[TransCacheSize];
+				// recent translations, by virtual page
+
+    InstrHandler *threadedCode;	// handler for each word of mainMemory that
+				// is part of a translated basic block
+    int *blockLength;		// # of instructions in the basic block that
+				// starts at a word, or 0 if none translated
+    bool inBlock;		// is RunBlock running a block?  If so, 
+    int blockStartPC;		// where the block started, so that a trap
+				// can charge for the instructions run so far
+
+    bool interpretOnly;		// run every instruction through 
+				// OneInstruction (the reference interpreter),
+				// rather than the threaded-code engine
+
     bool singleStep;		// drop back into the debugger after each
 				// simulated instruction
     int runUntilTime;		// drop back into the debugger when simulated
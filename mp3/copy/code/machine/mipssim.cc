@@ -24,26 +24,6 @@
 
 static void Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr);
 
-// The following class defines an instruction, represented in both
-// 	undecoded binary form
-//      decoded to identify
-//	    operation to do
-//	    registers to act on
-//	    any immediate operand value
-
-class Instruction {
-  public:
-    void Decode();	// decode the binary representation of the instruction
-
-    unsigned int value; // binary representation of the instruction
-
-    char opCode;     // Type of instruction.  This is NOT the same as the
-    		     // opcode field from the instruction: see defs in mips.h
-    char rs, rt, rd; // Three registers from instruction.
-    int extra;       // Immediate or target or shamt field or offset.
-                     // Immediates are sign-extended.
-};
-
 //----------------------------------------------------------------------
 // Machine::Run
 // 	Simulate the execution of a user-level program on Nachos.
@@ -56,16 +36,19 @@ class Instruction {
 void
 Machine::Run()
 {
-    Instruction *instr = new Instruction;  // storage for decoded instruction
-
     if (debug->IsEnabled('m')) {
         cout << "Starting program in thread: " << kernel->currentThread->getName();
 	cout << ", at time: " << kernel->stats->totalTicks << "\n";
     }
     kernel->interrupt->setStatus(UserMode);
     for (;;) {
+	if (!interpretOnly && !singleStep && !debug->IsEnabled(dbgMach)
+			&& !debug->IsEnabled(dbgTraCode)) {
+	    RunBlock();			// fast path: a basic block at a time
+	    continue;
+	}
 	DEBUG(dbgTraCode, "In Machine::Run(), into OneInstruction " << "== Tick " << kernel->stats->totalTicks << " ==");
-        OneInstruction(instr);
+        OneInstruction();
 	DEBUG(dbgTraCode, "In Machine::Run(), return from OneInstruction  " << "== Tick " << kernel->stats->totalTicks << " ==");
 		
 	DEBUG(dbgTraCode, "In Machine::Run(), into OneTick " << "== Tick " << kernel->stats->totalTicks << " ==");
@@ -123,22 +106,13 @@ TypeToReg(RegType reg, Instruction *instr)
 //----------------------------------------------------------------------
 
 void
-Machine::OneInstruction(Instruction *instr)
+Machine::OneInstruction()
 {
-#ifdef SIM_FIX
-    int byte;       // described in Kane for LWL,LWR,...
-#endif
-
-    int raw;
-    int nextLoadReg = 0; 	
-    int nextLoadValue = 0; 	// record delayed load operation, to apply
-				// in the future
+    Instruction *instr;
 
-    // Fetch instruction 
-    if (!ReadMem(registers[PCReg], 4, &raw))
+    // Fetch (and if need be, decode) instruction 
+    if ((instr = FetchInstruction(registers[PCReg])) == NULL)
 	return;			// exception occurred
-    instr->value = raw;
-    instr->Decode();
 
     if (debug->IsEnabled('m')) {
         struct OpString *str = &opStrings[instr->opCode];
@@ -150,7 +124,32 @@ Machine::OneInstruction(Instruction *instr)
 	     TypeToReg(str->args[1], instr), TypeToReg(str->args[2], instr));
         cout << "\t" << buf << "\n";
     }
-    
+
+    (void) ExecInstruction(instr);
+}
+
+//----------------------------------------------------------------------
+// Machine::ExecInstruction
+// 	Execute one decoded instruction, then apply any delayed load and
+//	advance the program counters.  This is the reference definition
+//	of every instruction: the threaded-code engine (see RunBlock)
+//	falls back on it for anything it has no handler for.
+//
+//	Returns FALSE if the instruction trapped to the kernel, in which
+//	case the PC has not been advanced.
+//----------------------------------------------------------------------
+
+bool
+Machine::ExecInstruction(Instruction *instr)
+{
+#ifdef SIM_FIX
+    int byte;       // described in Kane for LWL,LWR,...
+#endif
+
+    int nextLoadReg = 0; 	
+    int nextLoadValue = 0; 	// record delayed load operation, to apply
+				// in the future
+
     // Compute next pc, but don't install in case there's an error or branch.
     int pcAfter = registers[NextPCReg] + 4;
     int sum, diff, tmp, value;
@@ -164,7 +163,7 @@ Machine::OneInstruction(Instruction *instr)
 	if (!((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT) &&
 	    ((registers[instr->rs] ^ sum) & SIGN_BIT)) {
 	    RaiseException(OverflowException, 0);
-	    return;
+	    return FALSE;
 	}
 	registers[instr->rd] = sum;
 	break;
@@ -174,7 +173,7 @@ Machine::OneInstruction(Instruction *instr)
 	if (!((registers[instr->rs] ^ instr->extra) & SIGN_BIT) &&
 	    ((instr->extra ^ sum) & SIGN_BIT)) {
 	    RaiseException(OverflowException, 0);
-	    return;
+	    return FALSE;
 	}
 	registers[instr->rt] = sum;
 	break;
@@ -269,7 +268,7 @@ Machine::OneInstruction(Instruction *instr)
       case OP_LBU:
 	tmp = registers[instr->rs] + instr->extra;
 	if (!ReadMem(tmp, 1, &value))
-	    return;
+	    return FALSE;
 
 	if ((value & 0x80) && (instr->opCode == OP_LB))
 	    value |= 0xffffff00;
@@ -284,10 +283,10 @@ Machine::OneInstruction(Instruction *instr)
 	tmp = registers[instr->rs] + instr->extra;
 	if (tmp & 0x1) {
 	    RaiseException(AddressErrorException, tmp);
-	    return;
+	    return FALSE;
 	}
 	if (!ReadMem(tmp, 2, &value))
-	    return;
+	    return FALSE;
 
 	if ((value & 0x8000) && (instr->opCode == OP_LH))
 	    value |= 0xffff0000;
@@ -306,10 +305,10 @@ Machine::OneInstruction(Instruction *instr)
 	tmp = registers[instr->rs] + instr->extra;
 	if (tmp & 0x3) {
 	    RaiseException(AddressErrorException, tmp);
-	    return;
+	    return FALSE;
 	}
 	if (!ReadMem(tmp, 4, &value))
-	    return;
+	    return FALSE;
 	nextLoadReg = instr->rt;
 	nextLoadValue = value;
 	break;
@@ -329,7 +328,7 @@ Machine::OneInstruction(Instruction *instr)
         // DEBUG('P', "Addr 0x%X\n",tmp-byte);
 
         if (!ReadMem(tmp-byte, 4, &value))
-            return;
+            return FALSE;
 #else
 	// ReadMem assumes all 4 byte requests are aligned on an even 
 	// word boundary.  Also, the little endian/big endian swap code would
@@ -337,7 +336,7 @@ Machine::OneInstruction(Instruction *instr)
 	ASSERT((tmp & 0x3) == 0);  
 
 	if (!ReadMem(tmp, 4, &value))
-	    return;
+	    return FALSE;
 #endif
 
 	if (registers[LoadReg] == instr->rt)
@@ -381,7 +380,7 @@ Machine::OneInstruction(Instruction *instr)
         // DEBUG('P', "Addr 0x%X\n",tmp-byte);
 
         if (!ReadMem(tmp-byte, 4, &value))
-            return;
+            return FALSE;
 #else
 	// ReadMem assumes all 4 byte requests are aligned on an even 
 	// word boundary.  Also, the little endian/big endian swap code would
@@ -389,7 +388,7 @@ Machine::OneInstruction(Instruction *instr)
 	ASSERT((tmp & 0x3) == 0);  
 
 	if (!ReadMem(tmp, 4, &value))
-	    return;
+	    return FALSE;
 #endif
 
 	if (registers[LoadReg] == instr->rt)
@@ -463,13 +462,13 @@ Machine::OneInstruction(Instruction *instr)
       case OP_SB:
 	if (!WriteMem((unsigned) 
 		(registers[instr->rs] + instr->extra), 1, registers[instr->rt]))
-	    return;
+	    return FALSE;
 	break;
 	
       case OP_SH:
 	if (!WriteMem((unsigned) 
 		(registers[instr->rs] + instr->extra), 2, registers[instr->rt]))
-	    return;
+	    return FALSE;
 	break;
 	
       case OP_SLL:
@@ -539,7 +538,7 @@ Machine::OneInstruction(Instruction *instr)
 	if (((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT) &&
 	    ((registers[instr->rs] ^ diff) & SIGN_BIT)) {
 	    RaiseException(OverflowException, 0);
-	    return;
+	    return FALSE;
 	}
 	registers[instr->rd] = diff;
 	break;
@@ -551,7 +550,7 @@ Machine::OneInstruction(Instruction *instr)
       case OP_SW:
 	if (!WriteMem((unsigned) 
 		(registers[instr->rs] + instr->extra), 4, registers[instr->rt]))
-	    return;
+	    return FALSE;
 	break;
 	
       case OP_SWL:	  
@@ -567,7 +566,7 @@ Machine::OneInstruction(Instruction *instr)
         byte = tmp & 0x3;
         // DEBUG('P', "Addr 0x%X\n",tmp-byte);
         if (!ReadMem(tmp-byte, 4, &value))
-            return;
+            return FALSE;
 
         // DEBUG('P', "Value 0x%X\n",value);
 #else
@@ -577,7 +576,7 @@ Machine::OneInstruction(Instruction *instr)
 	ASSERT((tmp & 0x3) == 0);  
 
 	if (!ReadMem((tmp & ~0x3), 4, &value))
-	    return;
+	    return FALSE;
 #endif
 
 #ifdef SIM_FIX
@@ -604,12 +603,12 @@ Machine::OneInstruction(Instruction *instr)
 	}
 #ifndef SIM_FIX
         if (!WriteMem((tmp & ~0x3), 4, value))
-            return;
+            return FALSE;
 #else
         // DEBUG('P', "Value 0x%X\n",value);
 
         if (!WriteMem((tmp - byte), 4, value))
-            return;
+            return FALSE;
 #endif // SIM_FIX
 	break;
     	
@@ -622,7 +621,7 @@ Machine::OneInstruction(Instruction *instr)
         ASSERT((tmp & 0x3) == 0);  
 
         if (!ReadMem((tmp & ~0x3), 4, &value))
-            return;
+            return FALSE;
 #else
         // The only difference between this code and the BIG ENDIAN code
         // is that the ReadMem call is guaranteed an aligned access as 
@@ -635,7 +634,7 @@ Machine::OneInstruction(Instruction *instr)
         // DEBUG('P', "Addr 0x%X\n",tmp-byte);
 
         if (!ReadMem(tmp-byte, 4, &value))
-            return;
+            return FALSE;
         // DEBUG('P', "Value 0x%X\n",value);
 #endif // SIM_FIX
 
@@ -661,12 +660,12 @@ Machine::OneInstruction(Instruction *instr)
 
 #ifndef SIM_FIX
         if (!WriteMem((tmp & ~0x3), 4, value))
-            return;
+            return FALSE;
 #else
         // DEBUG('P', "Value 0x%X\n",value);
 
         if (!WriteMem((tmp - byte), 4, value))
-            return;
+            return FALSE;
 #endif // SIM_FIX
 
 
@@ -675,7 +674,7 @@ Machine::OneInstruction(Instruction *instr)
       case OP_SYSCALL:
 	DEBUG(dbgTraCode, "In Machine::OneInstruction, RaiseException(SyscallException, 0), " << kernel->stats->totalTicks);
 	RaiseException(SyscallException, 0);
-	return; 
+	return FALSE; 
 	
       case OP_XOR:
 	registers[instr->rd] = registers[instr->rs] ^ registers[instr->rt];
@@ -688,7 +687,7 @@ Machine::OneInstruction(Instruction *instr)
       case OP_RES:
       case OP_UNIMP:
 	RaiseException(IllegalInstrException, 0);
-	return;
+	return FALSE;
 	
       default:
 	ASSERT(FALSE);
@@ -704,6 +703,619 @@ Machine::OneInstruction(Instruction *instr)
 						// are jumping into lala-land
     registers[PCReg] = registers[NextPCReg];
     registers[NextPCReg] = pcAfter;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::FetchInstruction
+// 	Fetch the instruction at virtual address "addr", the same way
+//	ReadMem would, but return its decoded form.  Decoding is done
+//	at most once per word of physical memory: the result is kept in
+//	decodeCache until the page holding it is written to.
+//
+//	Returns NULL if the translation failed (the exception has already
+//	been raised).
+//
+//	"addr" -- the virtual address of the instruction
+//----------------------------------------------------------------------
+
+Instruction *
+Machine::FetchInstruction(int addr)
+{
+    ExceptionType exception;
+    int physicalAddress;
+    Instruction *instr;
+    char *hostAddr;
+    int word;
+
+    if ((hostAddr = CachedTranslate(addr, 4, FALSE)) != NULL)
+	physicalAddress = hostAddr - mainMemory;
+    else {
+	DEBUG(dbgAddr, "Fetching instruction at VA " << addr);
+
+	exception = Translate(addr, &physicalAddress, 4, FALSE);
+	if (exception != NoException) {
+	    RaiseException(exception, addr);
+	    return NULL;
+	}
+    }
+    word = physicalAddress / 4;
+    instr = &decodeCache[word];
+    if (!decodeValid[word]) {
+	instr->value = WordToHost(*(unsigned int *) &mainMemory[physicalAddress]);
+	instr->Decode();
+	decodeValid[word] = TRUE;
+	codePage[physicalAddress / PageSize] = TRUE;
+    }
+    return instr;
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateDecodedPage
+// 	Forget every decoded instruction cached for physical page
+//	"pageFrame", because its contents are about to change (or just
+//	have).  Cheap if nothing on the page was ever executed.
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateDecodedPage(int pageFrame)
+{
+    int first = pageFrame * PageSize / 4;
+
+    if (!codePage[pageFrame])
+	return;
+    for (int i = first; i < first + PageSize / 4; i++) {
+	decodeValid[i] = FALSE;
+	blockLength[i] = 0;
+    }
+    codePage[pageFrame] = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Threaded-code engine
+//
+//	Rather than running each instruction through the big switch in
+//	ExecInstruction, the engine translates a straight-line run of
+//	instructions (a basic block) into an array of pointers to small
+//	handler routines, one per instruction, and then just calls them
+//	one after the other.  Simulated time is charged once per block,
+//	and pending interrupts are only looked at between blocks; a block
+//	is cut short if an interrupt would fall due in the middle of it,
+//	so the simulation behaves exactly as if OneTick were still called
+//	after every instruction.
+//
+//	A block never crosses a page boundary (the next page need not be
+//	adjacent in physical memory), and ends after the delay slot of a
+//	branch or jump, or after an instruction that always traps.
+//
+//	The handlers below cover the common instructions.  Anything
+//	else (overflow checking arithmetic, multiply and divide, the
+//	unaligned loads and stores, syscalls) goes through
+//	Machine::InterpretHandler, which calls ExecInstruction.
+//
+//	Every handler returns FALSE if the instruction trapped to the
+//	kernel, and otherwise retires the instruction the same way
+//	ExecInstruction does.
+//----------------------------------------------------------------------
+
+//----------------------------------------------------------------------
+// Retire
+// 	Finish a successfully executed instruction: do any delayed load,
+//	and advance the program counters.  Cf. Machine::DelayedLoad.
+//----------------------------------------------------------------------
+
+static inline bool
+Retire(int *r, int pcAfter, int nextLoadReg, int nextLoadValue)
+{
+    r[r[LoadReg]] = r[LoadValueReg];
+    r[LoadReg] = nextLoadReg;
+    r[LoadValueReg] = nextLoadValue;
+    r[0] = 0;
+    r[PrevPCReg] = r[PCReg];
+    r[PCReg] = r[NextPCReg];
+    r[NextPCReg] = pcAfter;
+    return TRUE;
+}
+
+static inline bool
+Retire(int *r)
+{
+    return Retire(r, r[NextPCReg] + 4, 0, 0);
+}
+
+static inline bool
+Branch(int *r, Instruction *instr, bool taken)
+{
+    if (taken)
+	return Retire(r, r[NextPCReg] + IndexToAddr(instr->extra), 0, 0);
+    return Retire(r);
+}
+
+static bool
+DoADDIU(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rt] = r[(int) instr->rs] + instr->extra;
+    return Retire(r);
+}
+
+static bool
+DoADDU(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = r[(int) instr->rs] + r[(int) instr->rt];
+    return Retire(r);
+}
+
+static bool
+DoSUBU(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = r[(int) instr->rs] - r[(int) instr->rt];
+    return Retire(r);
+}
+
+static bool
+DoAND(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = r[(int) instr->rs] & r[(int) instr->rt];
+    return Retire(r);
+}
+
+static bool
+DoANDI(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rt] = r[(int) instr->rs] & (instr->extra & 0xffff);
+    return Retire(r);
+}
+
+static bool
+DoOR(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = r[(int) instr->rs] | r[(int) instr->rt];
+    return Retire(r);
+}
+
+static bool
+DoORI(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rt] = r[(int) instr->rs] | (instr->extra & 0xffff);
+    return Retire(r);
+}
+
+static bool
+DoXOR(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = r[(int) instr->rs] ^ r[(int) instr->rt];
+    return Retire(r);
+}
+
+static bool
+DoXORI(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rt] = r[(int) instr->rs] ^ (instr->extra & 0xffff);
+    return Retire(r);
+}
+
+static bool
+DoNOR(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = ~(r[(int) instr->rs] | r[(int) instr->rt]);
+    return Retire(r);
+}
+
+static bool
+DoLUI(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rt] = instr->extra << 16;
+    return Retire(r);
+}
+
+// NOTE: as in ExecInstruction, SRL and SRLV shift a signed int, and so
+// propagate the sign bit exactly like SRA and SRAV.
+
+static bool
+DoSLL(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = r[(int) instr->rt] << instr->extra;
+    return Retire(r);
+}
+
+static bool
+DoSRA(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = r[(int) instr->rt] >> instr->extra;
+    return Retire(r);
+}
+
+static bool
+DoSLLV(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = r[(int) instr->rt] << (r[(int) instr->rs] & 0x1f);
+    return Retire(r);
+}
+
+static bool
+DoSRAV(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = r[(int) instr->rt] >> (r[(int) instr->rs] & 0x1f);
+    return Retire(r);
+}
+
+static bool
+DoSLT(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = (r[(int) instr->rs] < r[(int) instr->rt]) ? 1 : 0;
+    return Retire(r);
+}
+
+static bool
+DoSLTI(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rt] = (r[(int) instr->rs] < instr->extra) ? 1 : 0;
+    return Retire(r);
+}
+
+static bool
+DoSLTIU(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rt] = ((unsigned int) r[(int) instr->rs]
+			< (unsigned int) instr->extra) ? 1 : 0;
+    return Retire(r);
+}
+
+static bool
+DoSLTU(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = ((unsigned int) r[(int) instr->rs]
+			< (unsigned int) r[(int) instr->rt]) ? 1 : 0;
+    return Retire(r);
+}
+
+static bool
+DoMFHI(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = r[HiReg];
+    return Retire(r);
+}
+
+static bool
+DoMFLO(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = r[LoReg];
+    return Retire(r);
+}
+
+static bool
+DoMTHI(Machine *m, int *r, Instruction *instr)
+{
+    r[HiReg] = r[(int) instr->rs];
+    return Retire(r);
+}
+
+static bool
+DoMTLO(Machine *m, int *r, Instruction *instr)
+{
+    r[LoReg] = r[(int) instr->rs];
+    return Retire(r);
+}
+
+static bool
+DoBEQ(Machine *m, int *r, Instruction *instr)
+{
+    return Branch(r, instr, r[(int) instr->rs] == r[(int) instr->rt]);
+}
+
+static bool
+DoBNE(Machine *m, int *r, Instruction *instr)
+{
+    return Branch(r, instr, r[(int) instr->rs] != r[(int) instr->rt]);
+}
+
+static bool
+DoBLEZ(Machine *m, int *r, Instruction *instr)
+{
+    return Branch(r, instr, r[(int) instr->rs] <= 0);
+}
+
+static bool
+DoBGTZ(Machine *m, int *r, Instruction *instr)
+{
+    return Branch(r, instr, r[(int) instr->rs] > 0);
+}
+
+static bool
+DoBLTZ(Machine *m, int *r, Instruction *instr)
+{
+    return Branch(r, instr, (r[(int) instr->rs] & SIGN_BIT) != 0);
+}
+
+static bool
+DoBGEZ(Machine *m, int *r, Instruction *instr)
+{
+    return Branch(r, instr, (r[(int) instr->rs] & SIGN_BIT) == 0);
+}
+
+static bool
+DoJ(Machine *m, int *r, Instruction *instr)
+{
+    return Retire(r, ((r[NextPCReg] + 4) & 0xf0000000) |
+			IndexToAddr(instr->extra), 0, 0);
+}
+
+static bool
+DoJAL(Machine *m, int *r, Instruction *instr)
+{
+    r[R31] = r[NextPCReg] + 4;
+    return DoJ(m, r, instr);
+}
+
+static bool
+DoJR(Machine *m, int *r, Instruction *instr)
+{
+    return Retire(r, r[(int) instr->rs], 0, 0);
+}
+
+static bool
+DoJALR(Machine *m, int *r, Instruction *instr)
+{
+    r[(int) instr->rd] = r[NextPCReg] + 4;
+    return Retire(r, r[(int) instr->rs], 0, 0);
+}
+
+// Alignment is checked by ReadMem/WriteMem (in Translate), which raise
+// the same AddressErrorException ExecInstruction does.
+
+static bool
+DoLB(Machine *m, int *r, Instruction *instr)
+{
+    int value;
+
+    if (!m->ReadMem(r[(int) instr->rs] + instr->extra, 1, &value))
+	return FALSE;
+    if (value & 0x80)
+	value |= 0xffffff00;
+    else
+	value &= 0xff;
+    return Retire(r, r[NextPCReg] + 4, instr->rt, value);
+}
+
+static bool
+DoLBU(Machine *m, int *r, Instruction *instr)
+{
+    int value;
+
+    if (!m->ReadMem(r[(int) instr->rs] + instr->extra, 1, &value))
+	return FALSE;
+    return Retire(r, r[NextPCReg] + 4, instr->rt, value & 0xff);
+}
+
+static bool
+DoLH(Machine *m, int *r, Instruction *instr)
+{
+    int value;
+
+    if (!m->ReadMem(r[(int) instr->rs] + instr->extra, 2, &value))
+	return FALSE;
+    if (value & 0x8000)
+	value |= 0xffff0000;
+    else
+	value &= 0xffff;
+    return Retire(r, r[NextPCReg] + 4, instr->rt, value);
+}
+
+static bool
+DoLHU(Machine *m, int *r, Instruction *instr)
+{
+    int value;
+
+    if (!m->ReadMem(r[(int) instr->rs] + instr->extra, 2, &value))
+	return FALSE;
+    return Retire(r, r[NextPCReg] + 4, instr->rt, value & 0xffff);
+}
+
+static bool
+DoLW(Machine *m, int *r, Instruction *instr)
+{
+    int value;
+
+    if (!m->ReadMem(r[(int) instr->rs] + instr->extra, 4, &value))
+	return FALSE;
+    return Retire(r, r[NextPCReg] + 4, instr->rt, value);
+}
+
+static bool
+DoSB(Machine *m, int *r, Instruction *instr)
+{
+    if (!m->WriteMem((unsigned) (r[(int) instr->rs] + instr->extra), 1,
+			r[(int) instr->rt]))
+	return FALSE;
+    return Retire(r);
+}
+
+static bool
+DoSH(Machine *m, int *r, Instruction *instr)
+{
+    if (!m->WriteMem((unsigned) (r[(int) instr->rs] + instr->extra), 2,
+			r[(int) instr->rt]))
+	return FALSE;
+    return Retire(r);
+}
+
+static bool
+DoSW(Machine *m, int *r, Instruction *instr)
+{
+    if (!m->WriteMem((unsigned) (r[(int) instr->rs] + instr->extra), 4,
+			r[(int) instr->rt]))
+	return FALSE;
+    return Retire(r);
+}
+
+//----------------------------------------------------------------------
+// ThreadedHandler
+// 	Return the handler for an opcode, or NULL if it has to be
+//	interpreted by ExecInstruction.
+//----------------------------------------------------------------------
+
+static InstrHandler
+ThreadedHandler(int opCode)
+{
+    switch (opCode) {
+      case OP_ADDIU:	return DoADDIU;
+      case OP_ADDU:	return DoADDU;
+      case OP_SUBU:	return DoSUBU;
+      case OP_AND:	return DoAND;
+      case OP_ANDI:	return DoANDI;
+      case OP_OR:	return DoOR;
+      case OP_ORI:	return DoORI;
+      case OP_XOR:	return DoXOR;
+      case OP_XORI:	return DoXORI;
+      case OP_NOR:	return DoNOR;
+      case OP_LUI:	return DoLUI;
+      case OP_SLL:	return DoSLL;
+      case OP_SRL:	return DoSRA;
+      case OP_SRA:	return DoSRA;
+      case OP_SLLV:	return DoSLLV;
+      case OP_SRLV:	return DoSRAV;
+      case OP_SRAV:	return DoSRAV;
+      case OP_SLT:	return DoSLT;
+      case OP_SLTI:	return DoSLTI;
+      case OP_SLTIU:	return DoSLTIU;
+      case OP_SLTU:	return DoSLTU;
+      case OP_MFHI:	return DoMFHI;
+      case OP_MFLO:	return DoMFLO;
+      case OP_MTHI:	return DoMTHI;
+      case OP_MTLO:	return DoMTLO;
+      case OP_BEQ:	return DoBEQ;
+      case OP_BNE:	return DoBNE;
+      case OP_BLEZ:	return DoBLEZ;
+      case OP_BGTZ:	return DoBGTZ;
+      case OP_BLTZ:	return DoBLTZ;
+      case OP_BGEZ:	return DoBGEZ;
+      case OP_J:	return DoJ;
+      case OP_JAL:	return DoJAL;
+      case OP_JR:	return DoJR;
+      case OP_JALR:	return DoJALR;
+      case OP_LB:	return DoLB;
+      case OP_LBU:	return DoLBU;
+      case OP_LH:	return DoLH;
+      case OP_LHU:	return DoLHU;
+      case OP_LW:	return DoLW;
+      case OP_SB:	return DoSB;
+      case OP_SH:	return DoSH;
+      case OP_SW:	return DoSW;
+      default:		return NULL;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::InterpretHandler
+// 	Handler for the instructions the threaded-code engine has no
+//	special routine for: just run the reference interpreter.
+//----------------------------------------------------------------------
+
+bool
+Machine::InterpretHandler(Machine *machine, int *registers, Instruction *instr)
+{
+    return machine->ExecInstruction(instr);
+}
+
+//----------------------------------------------------------------------
+// Machine::TranslateBlock
+// 	Build the basic block that starts at word "word" of physical 
+//	memory: decode each instruction (unless already cached) and
+//	record its handler in threadedCode, then record the length of
+//	the block in blockLength.
+//
+//	The caller must already have fetched the first instruction, so
+//	the page is known to be mapped and marked in codePage.
+//----------------------------------------------------------------------
+
+void
+Machine::TranslateBlock(int word)
+{
+    int pageEnd = (word / (PageSize / 4) + 1) * (PageSize / 4);
+    bool inDelaySlot = FALSE;
+    bool endsBlock = FALSE;
+    Instruction *instr;
+    int w;
+
+    for (w = word; w < pageEnd && !endsBlock; w++) {
+	instr = &decodeCache[w];
+	if (!decodeValid[w]) {
+	    instr->value = WordToHost(*(unsigned int *) &mainMemory[w * 4]);
+	    instr->Decode();
+	    decodeValid[w] = TRUE;
+	}
+	threadedCode[w] = ThreadedHandler(instr->opCode);
+	if (threadedCode[w] == NULL)
+	    threadedCode[w] = InterpretHandler;
+
+	endsBlock = inDelaySlot;
+	switch (instr->opCode) {
+	  case OP_BEQ: case OP_BNE: case OP_BLEZ: case OP_BGTZ:
+	  case OP_BLTZ: case OP_BGEZ: case OP_BLTZAL: case OP_BGEZAL:
+	  case OP_J: case OP_JAL: case OP_JR: case OP_JALR:
+	    inDelaySlot = TRUE;		// stop after the next instruction
+	    break;
+	  case OP_SYSCALL: case OP_RES: case OP_UNIMP:
+	    endsBlock = TRUE;		// always traps
+	    break;
+	}
+    }
+    blockLength[word] = w - word;
+    DEBUG(dbgMach, "Translated block at " << word * 4 << ", length " 
+			<< blockLength[word]);
+}
+
+//----------------------------------------------------------------------
+// Machine::RunBlock
+// 	Run the basic block starting at the current PC, translating it
+//	first if this is the first time we get here.  Stops early at a
+//	taken branch, a trap, or when the next pending interrupt is due,
+//	and in any case charges the simulated time and checks for
+//	interrupts before returning -- just like calling OneInstruction
+//	and OneTick once for each instruction that was run.
+//----------------------------------------------------------------------
+
+void
+Machine::RunBlock()
+{
+    Instruction *instr;
+    int word, length, budget, pc, i;
+    bool ok = TRUE;
+
+    if ((instr = FetchInstruction(registers[PCReg])) == NULL) {
+	kernel->interrupt->UserTicks(1);	// exception occurred
+	return;
+    }
+    word = instr - decodeCache;
+    if (blockLength[word] == 0)
+	TranslateBlock(word);
+    length = blockLength[word];
+
+    // don't run past the point at which the next interrupt is due
+    budget = (kernel->interrupt->NextDueTime() - kernel->stats->totalTicks)
+							/ UserTick;
+    if (budget < 1)
+	budget = 1;
+    if (length > budget)
+	length = budget;
+
+    pc = blockStartPC = registers[PCReg];
+    inBlock = TRUE;
+    for (i = 0; i < length; ) {
+	ok = (*threadedCode[word + i])(this, registers, &decodeCache[word + i]);
+	i++;
+	if (!ok)
+	    break;			// trapped; RaiseException ended the block
+	pc += 4;
+	if (i < length && (registers[PCReg] != pc || !decodeValid[word + i]))
+	    break;			// branch taken, or the block was 
+					// overwritten by a store
+    }
+    inBlock = FALSE;
+
+    // If we trapped, RaiseException already charged for the instructions
+    // before the one that trapped.
+    kernel->interrupt->UserTicks(ok ? i : 1);
 }
 
 //----------------------------------------------------------------------
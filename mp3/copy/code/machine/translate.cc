@@ -88,27 +88,31 @@ Machine::ReadMem(int addr, int size, int *value)
     int data;
     ExceptionType exception;
     int physicalAddress;
+    char *hostAddr;
     
-    DEBUG(dbgAddr, "Reading VA " << addr << ", size " << size);
+    if ((hostAddr = CachedTranslate(addr, size, FALSE)) == NULL) {
+	DEBUG(dbgAddr, "Reading VA " << addr << ", size " << size);
     
-    exception = Translate(addr, &physicalAddress, size, FALSE);
-    if (exception != NoException) {
-	RaiseException(exception, addr);
-	return FALSE;
+	exception = Translate(addr, &physicalAddress, size, FALSE);
+	if (exception != NoException) {
+	    RaiseException(exception, addr);
+	    return FALSE;
+	}
+	hostAddr = &mainMemory[physicalAddress];
     }
     switch (size) {
       case 1:
-	data = mainMemory[physicalAddress];
+	data = *hostAddr;
 	*value = data;
 	break;
 	
       case 2:
-	data = *(unsigned short *) &mainMemory[physicalAddress];
+	data = *(unsigned short *) hostAddr;
 	*value = ShortToHost(data);
 	break;
 	
       case 4:
-	data = *(unsigned int *) &mainMemory[physicalAddress];
+	data = *(unsigned int *) hostAddr;
 	*value = WordToHost(data);
 	break;
 
@@ -137,27 +141,32 @@ Machine::WriteMem(int addr, int size, int value)
 {
     ExceptionType exception;
     int physicalAddress;
+    char *hostAddr;
      
-    DEBUG(dbgAddr, "Writing VA " << addr << ", size " << size << ", value " << value);
+    if ((hostAddr = CachedTranslate(addr, size, TRUE)) == NULL) {
+	DEBUG(dbgAddr, "Writing VA " << addr << ", size " << size << ", value " << value);
 
-    exception = Translate(addr, &physicalAddress, size, TRUE);
-    if (exception != NoException) {
-	RaiseException(exception, addr);
-	return FALSE;
+	exception = Translate(addr, &physicalAddress, size, TRUE);
+	if (exception != NoException) {
+	    RaiseException(exception, addr);
+	    return FALSE;
+	}
+	hostAddr = &mainMemory[physicalAddress];
     }
+    if (decodeValid[(hostAddr - mainMemory) / 4])	// overwriting code?
+	InvalidateDecodedPage((hostAddr - mainMemory) / PageSize);
     switch (size) {
       case 1:
-	mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
+	*hostAddr = (unsigned char) (value & 0xff);
 	break;
 
       case 2:
-	*(unsigned short *) &mainMemory[physicalAddress]
+	*(unsigned short *) hostAddr
 		= ShortToMachine((unsigned short) (value & 0xffff));
 	break;
       
       case 4:
-	*(unsigned int *) &mainMemory[physicalAddress]
-		= WordToMachine((unsigned int) value);
+	*(unsigned int *) hostAddr = WordToMachine((unsigned int) value);
 	break;
 	
       default: ASSERT(FALSE);
@@ -166,6 +175,46 @@ Machine::WriteMem(int addr, int size, int value)
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Machine::CachedTranslate
+// 	Try to translate a virtual address using only transCache.  A hit
+//	needs no further checking: an entry is only made (by Translate)
+//	once the page's use bit is set, and is only marked writable once
+//	its dirty bit is set, so skipping Translate loses nothing.
+//
+//	Returns a pointer to the addressed byte of mainMemory, or NULL
+//	on a miss or a misaligned access (which Translate will report).
+//
+//	"virtAddr" -- the virtual address to translate
+//	"size" -- the amount of memory being read or written
+// 	"writing" -- if TRUE, the entry must allow writes
+//----------------------------------------------------------------------
+
+char *
+Machine::CachedTranslate(int virtAddr, int size, bool writing)
+{
+    unsigned int vpn = (unsigned) virtAddr >> PageShift;
+    TransCacheEntry *cached = &transCache[vpn % TransCacheSize];
+
+    if (cached->virtualPage != (int) vpn || (virtAddr & (size - 1)) != 0
+	    || (writing && !cached->writable))
+	return NULL;
+    return cached->page + ((unsigned) virtAddr & (PageSize - 1));
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushTranslationCache
+// 	Empty transCache, so that the next reference to every page goes
+//	through Translate and sees the current page table or TLB.
+//----------------------------------------------------------------------
+
+void
+Machine::FlushTranslationCache()
+{
+    for (int i = 0; i < TransCacheSize; i++)
+	transCache[i].virtualPage = -1;
+}
+
 //----------------------------------------------------------------------
 // Machine::Translate
 // 	Translate a virtual address into a physical address, using 
@@ -202,8 +251,8 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 
 // calculate the virtual page number, and offset within the page,
 // from the virtual address
-    vpn = (unsigned) virtAddr / PageSize;
-    offset = (unsigned) virtAddr % PageSize;
+    vpn = (unsigned) virtAddr >> PageShift;
+    offset = (unsigned) virtAddr & (PageSize - 1);
     
     if (tlb == NULL) {		// => page table => vpn is index into table
 	if (vpn >= pageTableSize) {
@@ -215,13 +264,15 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 	}
 	entry = &pageTable[vpn];
     } else {
-        for (entry = NULL, i = 0; i < TLBSize; i++)
+        for (entry = NULL, i = 0; i < tlbSize; i++)
     	    if (tlb[i].valid && (tlb[i].virtualPage == ((int)vpn))) {
 		entry = &tlb[i];			// FOUND!
+		tlbLastUse[i] = ++kernel->stats->numTLBHits;
 		break;
 	    }
 	if (entry == NULL) {				// not found
     	    DEBUG(dbgAddr, "Invalid TLB entry for this virtual page!");
+	    kernel->stats->numTLBMisses++;
     	    return PageFaultException;		// really, this is a TLB fault,
 						// the page may be in memory,
 						// but not in the TLB
@@ -236,7 +287,7 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 
     // if the pageFrame is too big, there is something really wrong! 
     // An invalid translation was loaded into the page table or TLB. 
-    if (pageFrame >= NumPhysPages) { 
+    if (pageFrame >= (unsigned) NumPhysPages) { 
 	DEBUG(dbgAddr, "Illegal pageframe " << pageFrame);
 	return BusErrorException;
     }
@@ -246,5 +297,15 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     *physAddr = pageFrame * PageSize + offset;
     ASSERT((*physAddr >= 0) && ((*physAddr + size) <= MemorySize));
     DEBUG(dbgAddr, "phys addr = " << *physAddr);
+
+    // remember the translation, unless every reference is being traced
+    // or there is a TLB (whose hits must all be seen to be counted)
+    if (tlb == NULL && !debug->IsEnabled(dbgAddr)) {
+	TransCacheEntry *cached = &transCache[vpn % TransCacheSize];
+
+	cached->virtualPage = vpn;
+	cached->page = &mainMemory[pageFrame * PageSize];
+	cached->writable = entry->dirty && !entry->readOnly;
+    }
     return NoException;
 }
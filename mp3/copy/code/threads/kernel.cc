@@ -17,6 +17,7 @@
 #include "synchdisk.h"
 #include "post.h"
 #include "synchconsole.h"
+#include "bitmap.h"
 
 //----------------------------------------------------------------------
 // Kernel::Kernel
@@ -26,12 +27,21 @@
 
 Kernel::Kernel(int argc, char **argv)
 {
+    int pageSize = DefaultPageSize;
+    int numPhysPages = DefaultNumPhysPages;
+
     randomSlice = FALSE; 
     debugUserProg = FALSE;
+    interpretUserProg = FALSE;
+#ifdef USE_TLB
+    tlbSize = TLBSize;
+#else
+    tlbSize = 0;		// default is a linear page table
+#endif
+    tlbPolicy = TLBRandom;
     consoleIn = NULL;          // default is stdin
     consoleOut = NULL;         // default is stdout
     for (int i=0;i<10;i++) priorities[i] = 0;
-    for (int i=0;i<NumPhysPages;i++) usedPhyMem[i] = 0;
 #ifndef FILESYS_STUB
     formatFlag = FALSE;
 #endif
@@ -47,6 +57,33 @@ Kernel::Kernel(int argc, char **argv)
 	    	i++;
         } else if (strcmp(argv[i], "-s") == 0) {
             debugUserProg = TRUE;
+        } else if (strcmp(argv[i], "-I") == 0) {
+            interpretUserProg = TRUE;
+        } else if (strcmp(argv[i], "-tlb") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is # of entries
+            tlbSize = atoi(argv[++i]);
+            ASSERT(tlbSize >= 0);
+        } else if (strcmp(argv[i], "-tlbp") == 0) {
+            ASSERT(i + 1 < argc);
+            i++;
+            if (strcmp(argv[i], "random") == 0) {
+                tlbPolicy = TLBRandom;
+            } else if (strcmp(argv[i], "fifo") == 0) {
+                tlbPolicy = TLBFifo;
+            } else if (strcmp(argv[i], "clock") == 0) {
+                tlbPolicy = TLBClock;
+            } else if (strcmp(argv[i], "lru") == 0) {
+                tlbPolicy = TLBLru;
+            } else {
+                cout << "Unknown TLB policy " << argv[i] << "\n";
+                ASSERTNOTREACHED();
+            }
+        } else if (strcmp(argv[i], "-ps") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is # of bytes
+            pageSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-np") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is # of pages
+            numPhysPages = atoi(argv[++i]);
 		} else if (strcmp(argv[i], "-e") == 0) {
         	execfile[++execfileNum]= argv[++i];
 			cout << execfile[execfileNum] << "\n";
@@ -81,7 +118,9 @@ Kernel::Kernel(int argc, char **argv)
             i++;
         } else if (strcmp(argv[i], "-u") == 0) {
             cout << "Partial usage: nachos [-rs randomSeed]\n";
-	   		cout << "Partial usage: nachos [-s]\n";
+	   		cout << "Partial usage: nachos [-s] [-I]\n";
+            cout << "Partial usage: nachos [-tlb #] [-tlbp random|fifo|clock|lru]\n";
+            cout << "Partial usage: nachos [-ps #] [-np #]\n";
             cout << "Partial usage: nachos [-ci consoleIn] [-co consoleOut]\n";
 #ifndef FILESYS_STUB
 	    	cout << "Partial usage: nachos [-nf]\n";
@@ -89,6 +128,11 @@ Kernel::Kernel(int argc, char **argv)
             cout << "Partial usage: nachos [-n #] [-m #]\n";
 		}
     }
+
+    SetMemorySize(pageSize, numPhysPages);	// before the Machine is built
+    frameTable = new FrameInfo[NumPhysPages];
+    firstFreeFrame = -1;
+    for (int i=NumPhysPages-1;i>=0;i--) FreeFrame(i);
 }
 
 //----------------------------------------------------------------------
@@ -113,10 +157,12 @@ Kernel::Initialize()
     interrupt = new Interrupt;		// start up interrupt handling
     scheduler = new Scheduler();	// initialize the ready queue
     alarm = new Alarm(randomSlice);	// start up time slicing
-    machine = new Machine(debugUserProg);
+    machine = new Machine(debugUserProg, interpretUserProg, tlbSize);
     synchConsoleIn = new SynchConsoleInput(consoleIn); // input from stdin
     synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
     synchDisk = new SynchDisk();    //
+    swapMap = new Bitmap(NumSwapSlots); // the disk is all swap space
+    pagingLock = new Lock("paging");
 #ifdef FILESYS_STUB
     fileSystem = new FileSystem();
 #else
@@ -128,6 +174,39 @@ Kernel::Initialize()
     interrupt->Enable();
 }
 
+//----------------------------------------------------------------------
+// Kernel::AllocateFrame
+// 	Return a free frame of physical memory, taking it off the free
+//	list, or -1 if every frame is in use.
+//----------------------------------------------------------------------
+
+int
+Kernel::AllocateFrame()
+{
+    int frame = firstFreeFrame;
+
+    if (frame >= 0) {
+	firstFreeFrame = frameTable[frame].nextFree;
+	frameTable[frame].nextFree = -1;
+    }
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// Kernel::FreeFrame
+// 	Put frame "frame" back on the free list; nothing owns it any more.
+//----------------------------------------------------------------------
+
+void
+Kernel::FreeFrame(int frame)
+{
+    ASSERT(frame >= 0 && frame < NumPhysPages);
+    frameTable[frame].space = NULL;
+    frameTable[frame].image = NULL;
+    frameTable[frame].nextFree = firstFreeFrame;
+    firstFreeFrame = frame;
+}
+
 //----------------------------------------------------------------------
 // Kernel::~Kernel
 // 	Nachos is halting.  De-allocate global data structures.
@@ -143,6 +222,9 @@ Kernel::~Kernel()
     delete synchConsoleIn;
     delete synchConsoleOut;
     delete synchDisk;
+    delete swapMap;
+    delete pagingLock;
+    delete [] frameTable;
     delete fileSystem;
     // delete postOfficeIn;
     // delete postOfficeOut;
@@ -282,7 +364,7 @@ void Kernel::ExecAll()
 int Kernel::Exec(char* name, int priority)
 {
 	t[threadNum] = new Thread(name, threadNum);
-	t[threadNum]->space = new AddrSpace(usedPhyMem);
+	t[threadNum]->space = new AddrSpace();
     t[threadNum]->SetPriority(priority);
 	t[threadNum]->Fork((VoidFunctionPtr) &ForkExecute, (void *)t[threadNum]);
 	threadNum++;
@@ -24,6 +24,8 @@ class PostOfficeOutput;
 class SynchConsoleInput;
 class SynchConsoleOutput;
 class SynchDisk;
+class Bitmap;
+class Lock;
 
 typedef int OpenFileId;
 
@@ -53,6 +55,10 @@ class Kernel {
     int ReadFile(char* buffer, int size, OpenFileId id); // fileSystem call
     int CloseFile(OpenFileId id); // fileSystem call
 
+    int AllocateFrame();        // Take a frame off the free list; -1 if
+                                // there are none
+    void FreeFrame(int frame);  // Put a frame back on the free list
+
 // These are public for notational convenience; really, 
 // they're global variables used everywhere.
 
@@ -71,6 +77,13 @@ class Kernel {
 
     int hostName;               // machine identifier
 
+    FrameInfo *frameTable;      // whose page is in each physical frame
+                                // (NumPhysPages entries)
+    int firstFreeFrame;         // head of the free list, or -1 if empty
+    Bitmap *swapMap;            // which swap slots on the disk are in use
+    Lock *pagingLock;           // held while paging in or out
+    TLBPolicy tlbPolicy;        // how to pick the TLB entry to replace
+
   private:
 
     Thread* t[10];
@@ -80,11 +93,12 @@ class Kernel {
     int threadNum;
     bool randomSlice;		// enable pseudo-random time slicing
     bool debugUserProg;         // single step user program
+    bool interpretUserProg;     // run user programs on the reference
+                                // interpreter, not the threaded-code engine
+    int tlbSize;                // # of TLB entries; 0 for a page table
     double reliability;         // likelihood messages are dropped
     char *consoleIn;            // file to read console input from
     char *consoleOut;           // file to send console output to
-
-    int usedPhyMem[NumPhysPages];
 #ifndef FILESYS_STUB
     bool formatFlag;          // format the disk if this is true
 #endif
@@ -3,7 +3,9 @@
 //	operating system kernel.  
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
-//              -s -x <nachos file> -ci <consoleIn> -co <consoleOut>
+//              -s -I -x <nachos file> -ci <consoleIn> -co <consoleOut>
+//              -tlb <# of entries> -tlbp <TLB policy>
+//              -ps <page size> -np <# of physical pages>
 //              -f -cp <unix file> <nachos file>
 //              -p <nachos file> -r <nachos file> -l -D
 //              -n <network reliability> -m <machine id>
@@ -13,6 +15,15 @@
 //    -rs causes Yield to occur at random (but repeatable) spots
 //    -z prints the copyright message
 //    -s causes user programs to be executed in single-step mode
+//    -I runs user programs on the reference interpreter, one instruction
+//       at a time, instead of the threaded-code engine (for comparing
+//       results; both should behave identically)
+//    -tlb translates user addresses with a software-loaded TLB of this
+//       many entries, refilled by the kernel, rather than a page table
+//    -tlbp chooses which TLB entry a refill replaces: random (the
+//       default), fifo, clock or lru
+//    -ps sets the size of a page, in bytes (a power of two; 128 by default)
+//    -np sets the number of pages of physical memory (128 by default)
 //    -x runs a user program
 //    -ci specify file for console input (stdin is the default)
 //    -co specify file for console output (stdout is the default)
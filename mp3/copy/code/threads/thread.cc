@@ -73,6 +73,8 @@ Thread::~Thread()
     ASSERT(this != kernel->currentThread);
     if (stack != NULL)
 	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+    if (space != NULL)		// give back its frames and swap slots
+	delete space;
 }
 
 //----------------------------------------------------------------------
@@ -19,7 +19,9 @@
 #include "main.h"
 #include "addrspace.h"
 #include "machine.h"
-#include "noff.h"
+#include "bitmap.h"
+#include "synch.h"
+#include "synchdisk.h"
 
 //----------------------------------------------------------------------
 // SwapHeader
@@ -57,49 +59,231 @@ SwapHeader (NoffHeader *noffH)
 #endif
 }
 
+static SharedImage *images = NULL;	// every program being run
+
 //----------------------------------------------------------------------
-// AddrSpace::AddrSpace
-// 	Create an address space to run a user program.
-//	Set up the translation from program memory to physical 
-//	memory.  For now, this is really simple (1:1), since we are
-//	only uniprogramming, and we have a single unsegmented page table
+// SegmentBytes
+// 	Return how many bytes of the page starting at user address 
+//	"pageAddr" lie in segment "seg".
 //----------------------------------------------------------------------
 
-AddrSpace::AddrSpace(int *usedPhysMem)
+static int
+SegmentBytes(Segment *seg, int pageAddr)
 {
-    pageTable = new TranslationEntry[NumPhysPages];
-    for (int i = 0; i < NumPhysPages; i++) {
-	pageTable[i].virtualPage = i;	// for now, virt page # = phys page #
-	pageTable[i].physicalPage = -1;
-	pageTable[i].valid = TRUE;
-	pageTable[i].use = FALSE;
-	pageTable[i].dirty = FALSE;
-	pageTable[i].readOnly = FALSE;  
+    int from = max(pageAddr, seg->virtualAddr);
+    int to = min(pageAddr + PageSize, seg->virtualAddr + seg->size);
+
+    return (seg->size > 0 && from < to) ? to - from : 0;
+}
+
+//----------------------------------------------------------------------
+// SharedImage::Attach
+// 	Return the image of the program in file "fileName", for address
+//	space "space" to run.  If some other address space is already
+//	running the program, share its image; otherwise open the file.
+//	Returns NULL if the file can't be opened.
+//----------------------------------------------------------------------
+
+SharedImage *
+SharedImage::Attach(char *fileName, AddrSpace *space)
+{
+    SharedImage *image;
+    OpenFile *file;
+
+    for (image = images; image != NULL; image = image->next)
+	if (strcmp(image->name, fileName) == 0)
+	    break;
+    if (image == NULL) {
+	if ((file = kernel->fileSystem->Open(fileName)) == NULL)
+	    return NULL;
+	image = new SharedImage(fileName, file);
+	image->next = images;
+	images = image;
+    } else {
+	DEBUG(dbgAddr, "Sharing the image of " << fileName);
     }
-    usedPhyMemBackup = usedPhysMem;
-    
-    // zero out the entire address space
-    bzero(kernel->machine->mainMemory, MemorySize);
+    image->spaces->Append(space);
+    return image;
+}
+
+//----------------------------------------------------------------------
+// SharedImage::Detach
+// 	Address space "space" is going away.  If it was the last one
+//	using the image, free the image's frames and delete it.
+//----------------------------------------------------------------------
+
+void
+SharedImage::Detach(AddrSpace *space)
+{
+    SharedImage **prev;
+
+    spaces->Remove(space);
+    if (!spaces->IsEmpty())
+	return;
+
+    for (prev = &images; *prev != this; prev = &(*prev)->next)
+	;
+    *prev = next;
+    for (unsigned int i = 0; i < numPages; i++)
+	if (frame[i] >= 0)
+	    kernel->FreeFrame(frame[i]);
+    delete this;
+}
+
+//----------------------------------------------------------------------
+// SharedImage::SharedImage
+// 	Read the NOFF header of a program, and work out which of its 
+//	pages are text pages: ones entirely filled with code and 
+//	read-only data, that can never be written.
+//
+//	"fileName" -- the name of the program
+//	"file" -- the program, already opened
+//----------------------------------------------------------------------
+
+SharedImage::SharedImage(char *fileName, OpenFile *file)
+{
+    int end, bytes;
+
+    name = new char[strlen(fileName) + 1];
+    strcpy(name, fileName);
+    executable = file;
+    executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
+    if ((noffH.noffMagic != NOFFMAGIC) && 
+		(WordToHost(noffH.noffMagic) == NOFFMAGIC))
+    	SwapHeader(&noffH);
+    ASSERT(noffH.noffMagic == NOFFMAGIC);
+
+    end = noffH.code.virtualAddr + noffH.code.size;
+    end = max(end, noffH.initData.virtualAddr + noffH.initData.size);
+#ifdef RDATA
+    end = max(end, noffH.readonlyData.virtualAddr + noffH.readonlyData.size);
+#endif
+    numPages = divRoundUp(end, PageSize);
+
+    frame = new int[numPages];
+    textPage = new bool[numPages];
+    for (unsigned int i = 0; i < numPages; i++) {
+	frame[i] = -1;
+	bytes = SegmentBytes(&noffH.code, i * PageSize);
+#ifdef RDATA
+	bytes += SegmentBytes(&noffH.readonlyData, i * PageSize);
+#endif
+	textPage[i] = (bytes == PageSize);
+    }
+    spaces = new List<AddrSpace *>;
+}
+
+//----------------------------------------------------------------------
+// SharedImage::~SharedImage
+// 	Close the program; nobody is running it any more.
+//----------------------------------------------------------------------
+
+SharedImage::~SharedImage()
+{
+    delete executable;
+    delete [] frame;
+    delete [] textPage;
+    delete spaces;
+    delete [] name;
+}
+
+//----------------------------------------------------------------------
+// SharedImage::Referenced
+// 	Return TRUE if any address space has used page "vpn" of the image
+//	since the last time we asked, and clear their use bits.
+//----------------------------------------------------------------------
+
+bool
+SharedImage::Referenced(unsigned int vpn)
+{
+    ListIterator<AddrSpace *> iter(spaces);
+    TranslationEntry *entry;
+    bool used = FALSE;
+
+    for (; !iter.IsDone(); iter.Next()) {
+	entry = &iter.Item()->pageTable[vpn];
+	if (entry->valid && entry->physicalPage == frame[vpn]) {
+	    used |= entry->use;
+	    entry->use = FALSE;
+	}
+    }
+    return used;
+}
+
+//----------------------------------------------------------------------
+// SharedImage::Evict
+// 	Take page "vpn" of the image out of memory, unmapping it from 
+//	every address space that shares it.  It is never modified, so
+//	it can just be read back from the executable next time.
+//----------------------------------------------------------------------
+
+void
+SharedImage::Evict(unsigned int vpn)
+{
+    ListIterator<AddrSpace *> iter(spaces);
+    TranslationEntry *entry;
+
+    DEBUG(dbgAddr, "Dropping shared page " << vpn << " of " << name
+				<< " from frame " << frame[vpn]);
+    for (; !iter.IsDone(); iter.Next()) {
+	entry = &iter.Item()->pageTable[vpn];
+	if (entry->valid && entry->physicalPage == frame[vpn]) {
+	    iter.Item()->DropFromTLB(vpn);
+	    entry->valid = FALSE;
+	}
+    }
+    kernel->machine->FlushTranslationCache();
+    kernel->frameTable[frame[vpn]].image = NULL;
+    frame[vpn] = -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddrSpace
+// 	Create an address space to run a user program.  The page table
+//	is set up by Load, once we know how big the program is.  No 
+//	memory is cleared here: each page is loaded or zeroed when it 
+//	is first touched (see PageIn).
+//----------------------------------------------------------------------
+
+AddrSpace::AddrSpace()
+{
+    pageTable = NULL;
+    numPages = 0;
+    swapSlot = NULL;
+    image = NULL;
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
-// 	Dealloate an address space.
+// 	Dealloate an address space, giving back its frames (but not the
+//	shared ones, which belong to the image) and swap slots.
 //----------------------------------------------------------------------
 
 AddrSpace::~AddrSpace()
 {
-    for (int k=preIdx;k<preIdx+numPages;k++) usedPhyMemBackup[k] = 0;
-   delete pageTable;
+    for (unsigned int i = 0; i < numPages; i++) {
+	if (pageTable[i].valid 
+		&& kernel->frameTable[pageTable[i].physicalPage].space == this)
+	    kernel->FreeFrame(pageTable[i].physicalPage);
+	if (swapSlot[i] >= 0)
+	    kernel->swapMap->Clear(swapSlot[i]);
+    }
+    delete [] pageTable;
+    delete [] swapSlot;
+    if (image != NULL)
+	image->Detach(this);
 }
 
 
 //----------------------------------------------------------------------
 // AddrSpace::Load
-// 	Load a user program into memory from a file.
+// 	Prepare to run a user program from a file.
 //
-//	Assumes that the page table has been initialized, and that
-//	the object code file is in NOFF format.
+//	Assumes that the object code file is in NOFF format.  Nothing is 
+//	read into memory yet: every page starts out invalid, and is 
+//	loaded the first time it is touched (see PageIn), either from
+//	the file or, if another address space is running the same 
+//	program, by sharing its copy (see SharedImage).
 //
 //	"fileName" is the file containing the object code to load into memory
 //----------------------------------------------------------------------
@@ -107,20 +291,15 @@ AddrSpace::~AddrSpace()
 bool 
 AddrSpace::Load(char *fileName) 
 {
-    OpenFile *executable = kernel->fileSystem->Open(fileName);
     NoffHeader noffH;
     unsigned int size;
 
-    if (executable == NULL) {
+    image = SharedImage::Attach(fileName, this);
+    if (image == NULL) {
 	cerr << "Unable to open file " << fileName << "\n";
 	return FALSE;
     }
-
-    executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
-    if ((noffH.noffMagic != NOFFMAGIC) && 
-		(WordToHost(noffH.noffMagic) == NOFFMAGIC))
-    	SwapHeader(&noffH);
-    ASSERT(noffH.noffMagic == NOFFMAGIC);
+    noffH = image->noffH;
 
 #ifdef RDATA
 // how big is address space?
@@ -137,57 +316,24 @@ AddrSpace::Load(char *fileName)
     numPages = divRoundUp(size, PageSize);
     size = numPages * PageSize;
 
-    for (int i=0;i<NumPhysPages;i++) {
-        if (usedPhyMemBackup[i] == 0) {
-            preIdx = i;
-            break;
-        }
-    }
-    for (int i=0;i<numPages;i++) pageTable[i].physicalPage = preIdx+i;
-    // Blocked used physical sized
-    for (int k=preIdx;k<preIdx+numPages;k++) usedPhyMemBackup[k] = 1;
-
-    ASSERT(numPages <= NumPhysPages);		// check we're not trying
+    ASSERT((int) numPages <= NumSwapSlots);	// check we're not trying
 						// to run anything too big --
-						// at least until we have
-						// virtual memory
+						// every page might have to
+						// be swapped out
 
     DEBUG(dbgAddr, "Initializing address space: " << numPages << ", " << size);
 
-// then, copy in the code and data segments into memory
-// Note: this code assumes that virtual address = physical address
-    unsigned int physicalAddr;
-    Translate(noffH.code.virtualAddr, &physicalAddr, 1);
-    if (noffH.code.size > 0) {
-        DEBUG(dbgAddr, "Initializing code segment.");
-	    DEBUG(dbgAddr, physicalAddr << ", " << noffH.code.size);
-        
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[physicalAddr]), 
-			noffH.code.size, noffH.code.inFileAddr);
-    }
-    if (noffH.initData.size > 0) {
-        DEBUG(dbgAddr, "Initializing data segment.");
-	    DEBUG(dbgAddr, physicalAddr << ", " << noffH.initData.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[physicalAddr]),
-			noffH.initData.size, noffH.initData.inFileAddr);
-    }
-
-#ifdef RDATA
-    unsigned int readonlyPhysicalAddr;
-    Translate(noffH.readonlyData.virtualAddr, &readonlyPhysicalAddr, 0);
-
-    if (noffH.readonlyData.size > 0) {
-        DEBUG(dbgAddr, "Initializing read only data segment.");
-	DEBUG(dbgAddr, readonlyPhysicalAddr << ", " << noffH.readonlyData.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[readonlyPhysicalAddr]),
-			noffH.readonlyData.size, noffH.readonlyData.inFileAddr);
+    pageTable = new TranslationEntry[numPages];
+    swapSlot = new int[numPages];
+    for (unsigned int i = 0; i < numPages; i++) {
+	pageTable[i].virtualPage = i;
+	pageTable[i].physicalPage = -1;
+	pageTable[i].valid = FALSE;		// not in memory yet
+	pageTable[i].use = FALSE;
+	pageTable[i].dirty = FALSE;
+	pageTable[i].readOnly = FALSE;  
+	swapSlot[i] = -1;
     }
-#endif
-
-    delete executable;			// close file
     return TRUE;			// success
 }
 
@@ -261,24 +407,193 @@ AddrSpace::InitRegisters()
 // 	On a context switch, save any machine state, specific
 //	to this address space, that needs saving.
 //
-//	For now, don't need to save anything!
+//	With a page table, don't need to save anything!  With a TLB,
+//	copy the use and dirty bits it collected back into our page
+//	table, since the next address space will flush it.
 //----------------------------------------------------------------------
 
 void AddrSpace::SaveState() 
-{}
+{
+    Machine *machine = kernel->machine;
+    TranslationEntry *entry;
+
+    if (machine->tlb == NULL)
+	return;
+    for (int i = 0; i < machine->tlbSize; i++) {
+	entry = &machine->tlb[i];
+	if (entry->valid) {
+	    pageTable[entry->virtualPage].use |= entry->use;
+	    pageTable[entry->virtualPage].dirty |= entry->dirty;
+	}
+    }
+}
 
 //----------------------------------------------------------------------
 // AddrSpace::RestoreState
 // 	On a context switch, restore the machine state so that
 //	this address space can run.
 //
-//      For now, tell the machine where to find the page table.
+//      With a page table, tell the machine where to find it.  With
+//	a TLB, flush it, so that it gets refilled from our page table
+//	(see HandlePageFault).  Either way, throw away the translations 
+//	the machine cached for the old address space.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState() 
 {
-    kernel->machine->pageTable = pageTable;
-    kernel->machine->pageTableSize = numPages;
+    Machine *machine = kernel->machine;
+
+    if (machine->tlb == NULL) {
+	machine->pageTable = pageTable;
+	machine->pageTableSize = numPages;
+    } else {
+	for (int i = 0; i < machine->tlbSize; i++)
+	    machine->tlb[i].valid = FALSE;
+    }
+    machine->FlushTranslationCache();
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::HandlePageFault
+// 	Called on a PageFaultException, when the machine could not find
+//	a valid translation for the virtual address _vaddr_.  Either the
+//	page is not in memory, so page it in, or (with a TLB) its entry
+//	was not in the TLB, so load it -- or both.
+//
+//	An address beyond the end of the address space is a bug in the
+//	user program, which is killed.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::HandlePageFault(unsigned int vaddr)
+{
+    unsigned int vpn = vaddr / PageSize;
+
+    if (vpn >= numPages) {
+	cerr << "Illegal virtual address " << vaddr << "\n";
+	kernel->currentThread->Finish();
+	ASSERTNOTREACHED();
+    }
+    kernel->pagingLock->Acquire();
+    if (!pageTable[vpn].valid)
+	PageIn(vpn);
+    if (kernel->machine->tlb != NULL)
+	LoadTLB(vpn);
+    kernel->pagingLock->Release();
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::HandleReadOnlyFault
+// 	Called on a ReadOnlyException, when the user program wrote to
+//	the virtual address _vaddr_ in a read-only page.  If the page
+//	is a shared copy of the program's data, this is the first write
+//	to it, so give the process its own copy to write to.
+//
+//	A write to a text page is a bug in the user program, which is
+//	killed.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::HandleReadOnlyFault(unsigned int vaddr)
+{
+    unsigned int vpn = vaddr / PageSize;
+
+    if (vpn >= numPages || vpn >= image->numPages 
+				|| image->IsTextPage(vpn)) {
+	cerr << "Write to read-only address " << vaddr << "\n";
+	kernel->currentThread->Finish();
+	ASSERTNOTREACHED();
+    }
+    kernel->pagingLock->Acquire();
+    if (!pageTable[vpn].valid)		// evicted while we waited
+	PageIn(vpn);
+    if (pageTable[vpn].readOnly)	// still shared
+	CopyOnWrite(vpn);
+    if (kernel->machine->tlb != NULL) {
+	DropFromTLB(vpn);
+	LoadTLB(vpn);
+    }
+    kernel->pagingLock->Release();
+}
+
+//----------------------------------------------------------------------
+// ChooseTLBVictim
+// 	Pick the TLB entry to replace, according to kernel->tlbPolicy.
+//	An invalid entry is always used first.  The clock policy clears
+//	the use bits it passes over, noting them in the page table
+//	first, so that the page table still knows the pages were used.
+//
+//	"pageTable" -- the page table the TLB entries were loaded from
+//----------------------------------------------------------------------
+
+static int
+ChooseTLBVictim(TranslationEntry *pageTable)
+{
+    static int hand = 0;		// next FIFO/clock candidate
+    Machine *machine = kernel->machine;
+    TranslationEntry *tlb = machine->tlb;
+    int size = machine->tlbSize;
+    int i, victim;
+
+    for (i = 0; i < size; i++)
+	if (!tlb[i].valid)
+	    return i;
+
+    switch (kernel->tlbPolicy) {
+      case TLBRandom:
+	return RandomNumber() % size;
+
+      case TLBFifo:
+	victim = hand;
+	hand = (hand + 1) % size;
+	return victim;
+
+      case TLBClock:
+	while (tlb[hand].use) {
+	    pageTable[tlb[hand].virtualPage].use = TRUE;
+	    tlb[hand].use = FALSE;
+	    hand = (hand + 1) % size;
+	}
+	victim = hand;
+	hand = (hand + 1) % size;
+	return victim;
+
+      case TLBLru:
+	victim = 0;
+	for (i = 1; i < size; i++)
+	    if (machine->tlbLastUse[i] < machine->tlbLastUse[victim])
+		victim = i;
+	return victim;
+    }
+    ASSERTNOTREACHED();
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadTLB
+// 	Load the page table entry for virtual page _vpn_ into the TLB,
+//	writing the use and dirty bits of the entry it replaces back
+//	into the page table.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::LoadTLB(unsigned int vpn)
+{
+    Machine *machine = kernel->machine;
+    int victim = ChooseTLBVictim(pageTable);
+    TranslationEntry *entry = &machine->tlb[victim];
+
+    if (entry->valid) {
+	DEBUG(dbgAddr, "TLB replacing virtual page " << entry->virtualPage);
+	pageTable[entry->virtualPage].use |= entry->use;
+	pageTable[entry->virtualPage].dirty |= entry->dirty;
+    }
+    DEBUG(dbgAddr, "TLB loading virtual page " << vpn << " into entry " << victim);
+    *entry = pageTable[vpn];
+    entry->use = FALSE;			// set by the retried reference
+    entry->dirty = FALSE;
+    machine->tlbLastUse[victim] = kernel->stats->numTLBHits;
+    machine->FlushTranslationCache();
 }
 
 
@@ -304,6 +619,10 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
 
     pte = &pageTable[vpn];
 
+    if(!pte->valid) {
+        return PageFaultException;
+    }
+
     if(isReadWrite && pte->readOnly) {
         return ReadOnlyException;
     }
@@ -324,7 +643,7 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
 
     *paddr = pfn*PageSize + offset;
 
-    ASSERT((*paddr < MemorySize));
+    ASSERT((*paddr < (unsigned) MemorySize));
 
     //cerr << " -- AddrSpace::Translate(): vaddr: " << vaddr <<
     //  ", paddr: " << *paddr << "\n";
@@ -332,6 +651,359 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
     return NoException;
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::CopyIn, CopyOut, CopyStringIn
+// 	Copy data between user virtual memory and a kernel buffer, for
+//	system calls.  The kernel can't just index mainMemory with a 
+//	user address: the pages needn't be contiguous, or even resident.
+//
+//	Return FALSE if part of the user's buffer is outside the address 
+//	space (or, for CopyOut, read-only).
+//
+//	"vaddr" -- the user virtual address
+//	"buf" -- the kernel buffer
+//	"size" -- the number of bytes to copy; for CopyStringIn, the 
+//		size of "buf", which is always null-terminated
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyIn(unsigned int vaddr, char *buf, int size)
+{
+    return CopyUser(vaddr, buf, size, FALSE);
+}
+
+bool
+AddrSpace::CopyOut(unsigned int vaddr, char *buf, int size)
+{
+    return CopyUser(vaddr, buf, size, TRUE);
+}
+
+bool
+AddrSpace::CopyStringIn(unsigned int vaddr, char *buf, int maxSize)
+{
+    for (int i = 0; i < maxSize - 1; i++) {
+	if (!CopyUser(vaddr + i, &buf[i], 1, FALSE)) {
+	    buf[i] = '\0';
+	    return FALSE;
+	}
+	if (buf[i] == '\0')
+	    return TRUE;
+    }
+    buf[maxSize - 1] = '\0';
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyUser
+// 	Copy "size" bytes between user address "vaddr" and "buf", a page
+//	at a time, paging in any page that isn't in memory.
+//
+//	"writing" -- if TRUE, copy from "buf" into user memory
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyUser(unsigned int vaddr, char *buf, int size, bool writing)
+{
+    unsigned int paddr;
+    ExceptionType exception;
+    int count;
+
+    while (size > 0) {
+	exception = Translate(vaddr, &paddr, writing);
+	if (exception == PageFaultException) {
+	    HandlePageFault(vaddr);
+	    continue;			// may have been evicted again
+	} else if (exception == ReadOnlyException 
+		&& vaddr / PageSize < image->numPages
+		&& !image->IsTextPage(vaddr / PageSize)) {
+	    HandleReadOnlyFault(vaddr);
+	    continue;
+	} else if (exception != NoException) {
+	    return FALSE;
+	}
+	count = min(size, PageSize - (int) (vaddr % PageSize));
+	if (writing) {
+	    bcopy(buf, &kernel->machine->mainMemory[paddr], count);
+	    kernel->machine->InvalidateDecodedPage(paddr / PageSize);
+	} else {
+	    bcopy(&kernel->machine->mainMemory[paddr], buf, count);
+	}
+	vaddr += count;
+	buf += count;
+	size -= count;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageIn
+// 	Bring virtual page _vpn_ into memory.  If it has been written to
+//	its swap slot, read it from there.  Otherwise, if it is one of
+//	the program's pages, map the image's copy of it read-only,
+//	loading that first if nobody has it in memory.  Otherwise it is
+//	uninitialized data or stack being touched for the first time
+//	(or since it was last evicted unmodified), so give it a zeroed
+//	frame of our own.  Must be called with kernel->pagingLock held.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::PageIn(unsigned int vpn)
+{
+    TranslationEntry *entry = &pageTable[vpn];
+    char *page;
+    char buf[SectorSize];
+    int frame, i;
+
+    kernel->stats->numPageFaults++;
+
+    if (swapSlot[vpn] < 0 && vpn < image->numPages) {
+	if ((frame = image->frame[vpn]) < 0) {
+	    frame = AllocateFrame();
+	    kernel->frameTable[frame].space = NULL;
+	    kernel->frameTable[frame].image = image;
+	    kernel->frameTable[frame].vpn = vpn;
+	    image->frame[vpn] = frame;
+	    LoadFromExecutable(vpn, frame);
+	} else {
+	    DEBUG(dbgAddr, "Mapping shared page " << vpn << " in frame "
+				<< frame);
+	}
+	entry->readOnly = TRUE;
+    } else {
+	frame = AllocateFrame();
+	kernel->frameTable[frame].space = this;
+	kernel->frameTable[frame].image = NULL;
+	kernel->frameTable[frame].vpn = vpn;
+	if (swapSlot[vpn] >= 0) {
+	    DEBUG(dbgAddr, "Paging in virtual page " << vpn << " from swap slot "
+				<< swapSlot[vpn] << " to frame " << frame);
+	    page = &kernel->machine->mainMemory[frame * PageSize];
+	    for (i = 0; i < SectorsPerPage; i++) {
+		kernel->synchDisk->ReadSector(
+				swapSlot[vpn] * SectorsPerPage + i, buf);
+		bcopy(buf, page + i * SectorSize,
+				min(SectorSize, PageSize - i * SectorSize));
+	    }
+	} else {
+	    DEBUG(dbgAddr, "Zero-filling virtual page " << vpn << " in frame "
+				<< frame);
+	    bzero(&kernel->machine->mainMemory[frame * PageSize], PageSize);
+	}
+	kernel->machine->InvalidateDecodedPage(frame);
+	entry->readOnly = FALSE;
+    }
+
+    entry->physicalPage = frame;
+    entry->use = FALSE;
+    entry->dirty = FALSE;
+    entry->valid = TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyOnWrite
+// 	Replace our mapping of the image's copy of virtual page _vpn_ by 
+//	a private, writable copy.  Must be called with kernel->pagingLock
+//	held.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::CopyOnWrite(unsigned int vpn)
+{
+    TranslationEntry *entry = &pageTable[vpn];
+    int frame = AllocateFrame();	// this may evict the image's copy
+
+    kernel->frameTable[frame].space = this;
+    kernel->frameTable[frame].image = NULL;
+    kernel->frameTable[frame].vpn = vpn;
+    if (image->frame[vpn] >= 0) {
+	DEBUG(dbgAddr, "Copying shared page " << vpn << " to frame " << frame);
+	bcopy(&kernel->machine->mainMemory[image->frame[vpn] * PageSize],
+		&kernel->machine->mainMemory[frame * PageSize], PageSize);
+	kernel->machine->InvalidateDecodedPage(frame);
+    } else {
+	LoadFromExecutable(vpn, frame);
+    }
+
+    entry->physicalPage = frame;
+    entry->readOnly = FALSE;
+    entry->use = FALSE;
+    entry->dirty = FALSE;
+    entry->valid = TRUE;
+    kernel->machine->FlushTranslationCache();
+}
+
+//----------------------------------------------------------------------
+// LoadSegment
+// 	Copy the part of segment "seg" that falls in the page starting at
+//	user address "pageAddr" from the executable into "page".
+//----------------------------------------------------------------------
+
+static void
+LoadSegment(OpenFile *executable, Segment *seg, int pageAddr, char *page)
+{
+    int from = max(pageAddr, seg->virtualAddr);
+    int to = min(pageAddr + PageSize, seg->virtualAddr + seg->size);
+
+    if (seg->size > 0 && from < to)
+	executable->ReadAt(page + (from - pageAddr), to - from,
+			seg->inFileAddr + (from - seg->virtualAddr));
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadFromExecutable
+// 	Fill frame _frame_ with the initial contents of virtual page _vpn_:
+//	whatever code and data the executable has for that page, and
+//	zeroes in the rest of it (where uninitialized data starts).
+//----------------------------------------------------------------------
+
+void
+AddrSpace::LoadFromExecutable(unsigned int vpn, int frame)
+{
+    char *page = &kernel->machine->mainMemory[frame * PageSize];
+    int pageAddr = vpn * PageSize;
+
+    DEBUG(dbgAddr, "Paging in virtual page " << vpn << " from executable"
+				<< " to frame " << frame);
+    bzero(page, PageSize);
+    LoadSegment(image->executable, &image->noffH.code, pageAddr, page);
+#ifdef RDATA
+    LoadSegment(image->executable, &image->noffH.readonlyData, pageAddr, page);
+#endif
+    LoadSegment(image->executable, &image->noffH.initData, pageAddr, page);
+    kernel->machine->InvalidateDecodedPage(frame);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AllocateFrame
+// 	Return a frame for a page to be loaded into.  If every frame is
+//	in use, evict whatever page ChooseVictimFrame picks.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::AllocateFrame()
+{
+    FrameInfo *victim;
+    int frame;
+
+    if ((frame = kernel->AllocateFrame()) >= 0)
+	return frame;
+
+    frame = ChooseVictimFrame();
+    victim = &kernel->frameTable[frame];
+    if (victim->image != NULL)
+	victim->image->Evict(victim->vpn);
+    else
+	victim->space->Evict(victim->vpn);
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ChooseVictimFrame
+// 	Pick a frame to evict, with the clock algorithm: sweep round the
+//	frames, clearing use bits, until we find a page that hasn't been
+//	used since the last sweep.  A shared page counts as used if any
+//	of the address spaces sharing it used it.
+//
+//	With a TLB, the use bits of the pages in it are first copied into
+//	the page table, so that they count.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::ChooseVictimFrame()
+{
+    static int hand = 0;
+    AddrSpace *current = kernel->currentThread->space;
+    FrameInfo *info;
+    TranslationEntry *entry;
+    int frame;
+
+    if (kernel->machine->tlb != NULL && current != NULL)
+	current->SaveState();
+    for (;;) {
+	frame = hand;
+	hand = (hand + 1) % NumPhysPages;
+	info = &kernel->frameTable[frame];
+	if (info->image != NULL) {
+	    if (!info->image->Referenced(info->vpn))
+		break;
+	} else {
+	    ASSERT(info->space != NULL);
+	    entry = &info->space->pageTable[info->vpn];
+	    if (!entry->use)
+		break;
+	    entry->use = FALSE;
+	}
+    }
+    kernel->machine->FlushTranslationCache();	// use bits were cleared
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Evict
+// 	Take virtual page _vpn_ out of memory, writing it to its swap slot
+//	(allocating one if need be) if it has been modified since it was
+//	loaded.  Must be called with kernel->pagingLock held.
+//
+//	Writing the page may block, and this address space may even be 
+//	deleted meanwhile (if its thread finishes), so all of the page's
+//	bookkeeping is done first.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::Evict(unsigned int vpn)
+{
+    Machine *machine = kernel->machine;
+    TranslationEntry *entry = &pageTable[vpn];
+    int frame = entry->physicalPage;
+    char *page = &machine->mainMemory[frame * PageSize];
+    char buf[SectorSize];
+    bool dirty;
+    int slot, i;
+
+    DropFromTLB(vpn);
+    dirty = entry->dirty;
+    entry->valid = FALSE;
+    entry->dirty = FALSE;
+    machine->FlushTranslationCache();
+    kernel->frameTable[frame].space = NULL;
+
+    if (!dirty) {		// the executable or swap slot is up to date
+	DEBUG(dbgAddr, "Dropping virtual page " << vpn << " from frame " << frame);
+	return;
+    }
+    if (swapSlot[vpn] < 0) {
+	swapSlot[vpn] = kernel->swapMap->FindAndSet();
+	ASSERT(swapSlot[vpn] >= 0);	// out of swap space
+    }
+    slot = swapSlot[vpn];
+    DEBUG(dbgAddr, "Paging out virtual page " << vpn << " from frame " 
+				<< frame << " to swap slot " << slot);
+    for (i = 0; i < SectorsPerPage; i++) {
+	bzero(buf, SectorSize);
+	bcopy(page + i * SectorSize, buf,
+			min(SectorSize, PageSize - i * SectorSize));
+	kernel->synchDisk->WriteSector(slot * SectorsPerPage + i, buf);
+    }
+}
 
+//----------------------------------------------------------------------
+// AddrSpace::DropFromTLB
+// 	If virtual page _vpn_ is in the TLB, invalidate its entry, after
+//	copying its dirty bit back into the page table.  The TLB only
+//	ever holds entries for the running address space.
+//----------------------------------------------------------------------
 
+void
+AddrSpace::DropFromTLB(unsigned int vpn)
+{
+    Machine *machine = kernel->machine;
 
+    if (machine->tlb == NULL || this != kernel->currentThread->space)
+	return;
+    for (int i = 0; i < machine->tlbSize; i++)
+	if (machine->tlb[i].valid 
+		&& machine->tlb[i].virtualPage == (int) vpn) {
+	    pageTable[vpn].dirty |= machine->tlb[i].dirty;
+	    machine->tlb[i].valid = FALSE;
+	}
+}
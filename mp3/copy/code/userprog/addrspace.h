@@ -15,12 +15,91 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "disk.h"
+#include "noff.h"
+#include "list.h"
 
 #define UserStackSize		1024 	// increase this as necessary!
 
+// Pages are loaded on demand, the first time they are touched.  When
+// memory is full, a page is evicted to make room, and written to a swap
+// area (if it was modified) that takes up the whole of the simulated
+// disk -- the stub file system doesn't use it.  Each page has its own
+// "swap slot" of SectorsPerPage consecutive sectors.
+
+#define SectorsPerPage		divRoundUp(PageSize, SectorSize)
+#define NumSwapSlots		(NumSectors / SectorsPerPage)
+
+class AddrSpace;
+
+// A program that one or more address spaces are running.  The pages
+// that start out the same in every copy of it -- the ones holding code,
+// read-only data or initialized data -- are loaded into memory just
+// once, into frames that all of the address spaces map.  Text pages
+// (only code and read-only data) are mapped read-only; the others are
+// copied the first time a process writes to them (copy-on-write).
+
+class SharedImage {
+  public:
+    static SharedImage *Attach(char *fileName, AddrSpace *space);
+				// Find the image of a program, opening
+				// it if nobody is running it yet.
+				// NULL if the file can't be opened.
+    void Detach(AddrSpace *space);
+				// "space" is done with the image; the
+				// last one to leave deletes it
+
+    bool IsTextPage(unsigned int vpn) { return textPage[vpn]; }
+				// Is page "vpn" read-only for good?
+    bool Referenced(unsigned int vpn);
+				// Has any address space used a page
+				// since we last asked?
+    void Evict(unsigned int vpn);
+				// Take a page out of memory, unmapping
+				// it in every address space
+
+    char *name;			// the program's file name
+    OpenFile *executable;	// where to load pages from
+    NoffHeader noffH;		// where in it each segment is
+    unsigned int numPages;	// # of pages with code or data in them
+    int *frame;			// where each page is in memory, or -1
+
+  private:
+    SharedImage(char *fileName, OpenFile *file);
+    ~SharedImage();
+
+    bool *textPage;		// which pages hold no writable data
+    List<AddrSpace *> *spaces;	// the address spaces using the image
+    SharedImage *next;		// next image on the kernel's list
+};
+
+// What the kernel knows about each frame of physical memory: whose page
+// is in it, so that the page can be evicted (see kernel->frameTable).
+// Free frames are kept on a list threaded through the table, so that
+// any free frame can be had in constant time (see Kernel::AllocateFrame).
+
+class FrameInfo {
+  public:
+    AddrSpace *space;		// owner of the page, or NULL if none
+    SharedImage *image;		// or, for a shared page, its image
+    unsigned int vpn;		// which of its virtual pages it is
+    int nextFree;		// if the frame is free, the next free 
+				// frame, or -1
+};
+
+// How the kernel picks which TLB entry to replace on a TLB miss,
+// once every entry is in use (see AddrSpace::LoadTLB).
+
+enum TLBPolicy { TLBRandom,		// any entry, at random
+		 TLBFifo,		// the entry loaded longest ago
+		 TLBClock,		// the next entry, round robin, whose
+					// use bit is clear
+		 TLBLru			// the entry referenced longest ago
+};
+
 class AddrSpace {
   public:
-    AddrSpace(int *);			// Create an address space.
+    AddrSpace();			// Create an address space.
     ~AddrSpace();			// De-allocate an address space
 
     bool Load(char *fileName);		// Load a program into addr space from
@@ -34,6 +113,21 @@ class AddrSpace {
     void SaveState();			// Save/restore address space-specific
     void RestoreState();		// info on a context switch 
 
+    void HandlePageFault(unsigned int vaddr);
+					// Make the page holding _vaddr_ 
+					// addressable again, by paging it
+					// in and/or loading it into the TLB
+    void HandleReadOnlyFault(unsigned int vaddr);
+					// Give the process its own copy of
+					// the shared page it wrote to
+
+    bool CopyIn(unsigned int vaddr, char *buf, int size);
+    bool CopyOut(unsigned int vaddr, char *buf, int size);
+    bool CopyStringIn(unsigned int vaddr, char *buf, int maxSize);
+					// Copy to/from user memory on behalf
+					// of a system call, paging in as
+					// needed.  FALSE if _vaddr_ is bad.
+
     // Translate virtual address _vaddr_
     // to physical address _paddr_. _mode_
     // is 0 for Read, 1 for Write.
@@ -48,9 +142,26 @@ class AddrSpace {
     void InitRegisters();		// Initialize user-level CPU registers,
 					// before jumping to user code
 
-    int *usedPhyMemBackup;
-    int preIdx;
+    void LoadTLB(unsigned int vpn);	// Copy a page table entry into the
+					// TLB, replacing some other entry
+
+    SharedImage *image;			// the program being run, where
+					// pages are loaded from
+    int *swapSlot;			// where each page is in the swap 
+					// area, or -1 if it has never been
+					// written there
+
+    bool CopyUser(unsigned int vaddr, char *buf, int size, bool writing);
+					// CopyIn/CopyOut, either way
+    void PageIn(unsigned int vpn);	// Load a page into a free frame
+    void LoadFromExecutable(unsigned int vpn, int frame);
+    void CopyOnWrite(unsigned int vpn);	// Replace a shared page by a copy
+    void Evict(unsigned int vpn);	// Take a page out of memory
+    void DropFromTLB(unsigned int vpn);	// Invalidate the page's TLB entry
+    int AllocateFrame();		// Find a frame, evicting if need be
+    static int ChooseVictimFrame();	// Which frame to evict
 
+    friend class SharedImage;		// unmaps shared pages
 };
 
 #endif // ADDRSPACE_H
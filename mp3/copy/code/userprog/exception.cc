@@ -25,6 +25,11 @@
 #include "main.h"
 #include "syscall.h"
 #include "ksyscall.h"
+
+// The longest string (eg, a file name) a system call will copy in from
+// user memory; anything longer is truncated.
+const int MaxStringLength = 256;
+
 //----------------------------------------------------------------------
 // ExceptionHandler
 // 	Entry point into the Nachos kernel.  Called when a user program
@@ -82,7 +87,8 @@ ExceptionHandler(ExceptionType which)
 		DEBUG(dbgSys, "Message received.\n");
 		val = kernel->machine->ReadRegister(4);
 		{
-		char *msg = &(kernel->machine->mainMemory[val]);
+		char msg[MaxStringLength];
+		kernel->currentThread->space->CopyStringIn(val, msg, MaxStringLength);
 		cout << msg << endl;
 		}
 		SysHalt();
@@ -91,7 +97,8 @@ ExceptionHandler(ExceptionType which)
 	    case SC_Create:
 		val = kernel->machine->ReadRegister(4);
 		{
-		char *filename = &(kernel->machine->mainMemory[val]);
+		char filename[MaxStringLength];
+		kernel->currentThread->space->CopyStringIn(val, filename, MaxStringLength);
 		//cout << filename << endl;
 		status = SysCreate(filename);
 		kernel->machine->WriteRegister(2, (int) status);
@@ -137,7 +144,8 @@ ExceptionHandler(ExceptionType which)
 		val = kernel->machine->ReadRegister(4);
 		{
 		// Get File Name
-    		char * filename = &(kernel->machine->mainMemory[val]);
+    		char filename[MaxStringLength];
+		kernel->currentThread->space->CopyStringIn(val, filename, MaxStringLength);
 	    	OpenFileId fd = SysOpen(filename);
                 
                 kernel->machine->WriteRegister(2, (int) fd);
@@ -156,9 +164,12 @@ ExceptionHandler(ExceptionType which)
                 int id = kernel->machine->ReadRegister(6);
 
                 // Write File
-                char * buffer = &(kernel->machine->mainMemory[bufferMemPos]);
-                int count = SysWrite(buffer, size, id);
+                char * buffer = new char[max(size, 0)];
+                int count = -1;
+                if (kernel->currentThread->space->CopyIn(bufferMemPos, buffer, size))
+                    count = SysWrite(buffer, size, id);
                 kernel->machine->WriteRegister(2, count); 
+                delete [] buffer;
                 }
                 kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
                 kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
@@ -173,9 +184,12 @@ ExceptionHandler(ExceptionType which)
                 int id = kernel->machine->ReadRegister(6);
 
                 // Read File
-                char * buffer = &(kernel->machine->mainMemory[bufferMemPos]);
+                char * buffer = new char[max(size, 0)];
                 int count = SysRead(buffer, size, id);
+                if (count > 0 && !kernel->currentThread->space->CopyOut(bufferMemPos, buffer, count))
+                    count = -1;
                 kernel->machine->WriteRegister(2, count);
+                delete [] buffer;
                 }
                 kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
                 kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
@@ -198,6 +212,16 @@ ExceptionHandler(ExceptionType which)
 	    break;
 	}
 	break;
+    case PageFaultException:
+	val = kernel->machine->ReadRegister(BadVAddrReg);
+	DEBUG(dbgAddr, "Page fault at " << val);
+	kernel->currentThread->space->HandlePageFault((unsigned int) val);
+	return;		// retry the faulting instruction
+    case ReadOnlyException:
+	val = kernel->machine->ReadRegister(BadVAddrReg);
+	DEBUG(dbgAddr, "Write to read-only page at " << val);
+	kernel->currentThread->space->HandleReadOnlyFault((unsigned int) val);
+	return;		// retry the faulting instruction
 	default:
 		cerr << "Unexpected user mode exception " << (int)which << "\n";
 		break;
@@ -7,24 +7,31 @@
 //	of each directory entry means that we have the restriction
 //	of a fixed maximum size for file names.
 //
+//	The table is a hash table on the file name.  When it fills up,
+//	it is rebuilt at twice the size, so there is no limit on the
+//	number of files in a directory, but the directory file then has
+//	to grow with it; that is up to the caller (see FileLength).
+//
 //	The constructor initializes an empty directory of a certain size;
 //	we use ReadFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
-//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
 #include "utility.h"
+#include "debug.h"
 #include "filehdr.h"
 #include "directory.h"
 
-#define NumDirEntries   10
+// The directory file is a DirectoryHeader, padded to the size of an
+// entry, and then the table; "slot" 0 of the file is the header, and
+// slot i + 1 is entry i.
+
+#define EntriesPerSector 	((int) (SectorSize / sizeof(DirectoryEntry)))
+#define SlotSector(index) 	(((index) + 1) / EntriesPerSector)
 
 //----------------------------------------------------------------------
 // Directory::Directory
@@ -38,6 +45,41 @@
 
 Directory::Directory(int size)
 {
+    table = NULL;
+    loaded = dirty = NULL;
+    Init(size);
+    allDirty = TRUE;			// there is nothing on disk yet
+}
+
+//----------------------------------------------------------------------
+// Directory::~Directory
+// 	De-allocate directory data structure.
+//----------------------------------------------------------------------
+
+Directory::~Directory()
+{ 
+    delete [] table;
+    delete [] loaded;
+    delete [] dirty;
+} 
+
+//----------------------------------------------------------------------
+// Directory::Init
+// 	Make the directory an empty table of a given size, all in memory.
+//
+//	"size" is the number of entries; a power of 2
+//----------------------------------------------------------------------
+
+void
+Directory::Init(int size)
+{
+    int numSectors;
+
+    ASSERT(size > 0 && (size & (size - 1)) == 0);
+    delete [] table;
+    delete [] loaded;
+    delete [] dirty;
+
     table = new DirectoryEntry[size];
 	
 	// MP4 mod tag
@@ -47,23 +89,25 @@ Directory::Directory(int size)
     for (int i = 0; i < tableSize; i++) {
         table[i].inUse = FALSE;
         table[i].isDir = FALSE;
+        table[i].removed = FALSE;
     }
+    numInUse = numRemoved = 0;
 
+    numSectors = divRoundUp(FileLength(), SectorSize);
+    loaded = new bool[numSectors];
+    dirty = new bool[numSectors];
+    for (int i = 0; i < numSectors; i++) {
+	loaded[i] = TRUE;
+	dirty[i] = FALSE;
+    }
+    openFile = NULL;
 }
 
-//----------------------------------------------------------------------
-// Directory::~Directory
-// 	De-allocate directory data structure.
-//----------------------------------------------------------------------
-
-Directory::~Directory()
-{ 
-    delete [] table;
-} 
-
 //----------------------------------------------------------------------
 // Directory::FetchFrom
-// 	Read the contents of the directory from disk.
+// 	Read the directory header from disk.  The entries themselves are
+//	read as they are needed (see Load), so "file" has to stay open
+//	while the directory is in use.
 //
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
@@ -71,12 +115,25 @@ Directory::~Directory()
 void
 Directory::FetchFrom(OpenFile *file)
 {
-    (void) file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    DirectoryHeader header;
+
+    (void) file->ReadAt((char *)&header, sizeof(DirectoryHeader), 0);
+    Init(header.tableSize);
+    numInUse = header.numInUse;
+    numRemoved = header.numRemoved;
+    for (int i = 0; i < divRoundUp(FileLength(), SectorSize); i++) {
+	loaded[i] = FALSE;
+    }
+    openFile = file;
+    allDirty = FALSE;
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-// 	Write any modifications to the directory back to disk
+// 	Write any modifications to the directory back to disk: the sectors
+//	of the file holding entries that changed, or all of it if the
+//	table has been rebuilt.  The file must already be FileLength
+//	bytes long.
 //
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
@@ -84,7 +141,174 @@ Directory::FetchFrom(OpenFile *file)
 void
 Directory::WriteBack(OpenFile *file)
 {
-    (void) file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    DirectoryHeader header;
+    int length = FileLength();
+    int numSectors = divRoundUp(length, SectorSize);
+    char *buf;
+
+    ASSERT(file->Length() >= length);
+    header.tableSize = tableSize;
+    header.numInUse = numInUse;
+    header.numRemoved = numRemoved;
+
+    if (allDirty) {
+	buf = new char[length];
+	memset(buf, 0, sizeof(DirectoryEntry));
+	memcpy(buf, &header, sizeof(DirectoryHeader));
+	memcpy(buf + sizeof(DirectoryEntry), table,
+			tableSize * sizeof(DirectoryEntry));
+	(void) file->WriteAt(buf, length, 0);
+	delete [] buf;
+    } else {
+	buf = new char[SectorSize];
+	for (int sector = 0; sector < numSectors; sector++) {
+	    if (!dirty[sector]) {
+		continue;
+	    }
+	    memset(buf, 0, SectorSize);
+	    for (int i = 0; i < EntriesPerSector; i++) {
+		int index = sector * EntriesPerSector + i - 1;
+
+		if (index == -1) {
+		    memcpy(buf, &header, sizeof(DirectoryHeader));
+		} else if (index < tableSize) {
+		    memcpy(buf + i * sizeof(DirectoryEntry), &table[index],
+				sizeof(DirectoryEntry));
+		}
+	    }
+	    (void) file->WriteAt(buf, min(SectorSize, length - sector * SectorSize),
+				sector * SectorSize);
+	}
+	delete [] buf;
+    }
+    for (int i = 0; i < numSectors; i++) {
+	dirty[i] = FALSE;
+    }
+    allDirty = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Directory::FileLength
+// 	Return the number of bytes the directory takes up on disk.
+//----------------------------------------------------------------------
+
+int
+Directory::FileLength()
+{
+    return (tableSize + 1) * sizeof(DirectoryEntry);
+}
+
+//----------------------------------------------------------------------
+// Directory::Load
+// 	Make sure a directory entry is in memory, reading the sector of
+//	the directory file that holds it, if it hasn't been read yet.
+//
+//	"index" -- the entry; -1 for the directory header
+//----------------------------------------------------------------------
+
+void
+Directory::Load(int index)
+{
+    int sector = SlotSector(index);
+    char buf[SectorSize];
+
+    if (loaded[sector]) {
+	return;
+    }
+    ASSERT(openFile != NULL);
+    (void) openFile->ReadAt(buf, SectorSize, sector * SectorSize);
+    for (int i = 0; i < EntriesPerSector; i++) {
+	int which = sector * EntriesPerSector + i - 1;
+
+	if (which >= 0 && which < tableSize) {
+	    memcpy(&table[which], buf + i * sizeof(DirectoryEntry),
+			sizeof(DirectoryEntry));
+	}
+    }
+    loaded[sector] = TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::LoadAll
+// 	Make sure every directory entry is in memory.
+//----------------------------------------------------------------------
+
+void
+Directory::LoadAll()
+{
+    for (int index = -1; index < tableSize; index += EntriesPerSector) {
+	Load(index);			// the first slot of each sector
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::SetDirty
+// 	Note that a directory entry has changed, so that its sector is
+//	written back.
+//
+//	"index" -- the entry; -1 for the directory header
+//----------------------------------------------------------------------
+
+void
+Directory::SetDirty(int index)
+{
+    Load(index);		// the rest of the sector is written too
+    dirty[SlotSector(index)] = TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::Hash
+// 	Return the hash of a file name (FNV-1a), which the caller reduces
+//	to the entry where a search for it starts.
+//
+//	"name" -- the file name
+//----------------------------------------------------------------------
+
+unsigned
+Directory::Hash(char *name)
+{
+    unsigned hash = 2166136261u;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++) {
+	hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+//----------------------------------------------------------------------
+// Directory::Resize
+// 	Rebuild the hash table at a new size, dropping the entries of
+//	removed files.  The whole directory is written back next time.
+//
+//	"newSize" -- the number of entries; a power of 2
+//----------------------------------------------------------------------
+
+void
+Directory::Resize(int newSize)
+{
+    DirectoryEntry *old;
+    int oldSize = tableSize;
+    int mask = newSize - 1;
+
+    LoadAll();
+    old = table;
+    table = NULL;
+    Init(newSize);
+    for (int i = 0; i < oldSize; i++) {
+	if (old[i].inUse) {
+	    int j = Hash(old[i].name) & mask;
+
+	    while (table[j].inUse) {
+		j = (j + 1) & mask;
+	    }
+	    table[j] = old[i];
+	    numInUse++;
+	}
+    }
+    delete [] old;
+    allDirty = TRUE;
+    DEBUG(dbgFile, "Directory resized from " << oldSize << " to " << newSize
+			<< " entries");
 }
 
 //----------------------------------------------------------------------
@@ -98,10 +322,18 @@ Directory::WriteBack(OpenFile *file)
 int
 Directory::FindIndex(char *name)
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
-	    return i;
-    return -1;		// name not in directory
+    int mask = tableSize - 1;
+
+    // the table is never full, so we get to a never-used entry
+    for (int i = Hash(name) & mask; ; i = (i + 1) & mask) {
+	Load(i);
+	if (table[i].inUse) {
+	    if (!strncmp(table[i].name, name, FileNameMaxLen))
+		return i;
+	} else if (!table[i].removed) {
+	    return -1;		// name not in directory
+	}
+    }
 }
 
 //----------------------------------------------------------------------
@@ -142,19 +374,31 @@ bool Directory::checkIfDir(char *name) {
 bool
 Directory::Add(char *name, int newSector, bool isDir)
 { 
+    int i;
+
     if (FindIndex(name) != -1)
 	return FALSE;
 
-    for (int i = 0; i < tableSize; i++) {
-        if (!table[i].inUse) {
-            table[i].inUse = TRUE;
-            table[i].isDir = isDir;
-            strncpy(table[i].name, name, FileNameMaxLen); 
-            table[i].sector = newSector;
-            return TRUE;
-	    }
+    if ((numInUse + numRemoved + 1) * 4 > tableSize * 3) {
+	Resize((numInUse + 1) * 2 > tableSize ? tableSize * 2 : tableSize);
+    }
+    i = Hash(name) & (tableSize - 1);
+    for (Load(i); table[i].inUse; Load(i)) {
+	i = (i + 1) & (tableSize - 1);
+    }
+    if (table[i].removed) {
+	numRemoved--;
     }
-    return FALSE;	// no space.  Fix when we have extensible files.
+    table[i].inUse = TRUE;
+    table[i].isDir = isDir;
+    table[i].removed = FALSE;
+    strncpy(table[i].name, name, FileNameMaxLen); 
+    table[i].name[FileNameMaxLen] = '\0';
+    table[i].sector = newSector;
+    numInUse++;
+    SetDirty(i);
+    SetDirty(-1);
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -173,6 +417,11 @@ Directory::Remove(char *name)
     if (i == -1)
 	return FALSE; 		// name not in directory
     table[i].inUse = FALSE;
+    table[i].removed = TRUE;	// later names may have been put past it
+    numInUse--;
+    numRemoved++;
+    SetDirty(i);
+    SetDirty(-1);
     return TRUE;	
 }
 
@@ -181,6 +430,7 @@ Directory::Remove(char *name)
 // 	List all the file names in the directory. 
 //----------------------------------------------------------------------
 void Directory::List() {
+    LoadAll();
     for (int i = 0; i < tableSize; i++) {
         if (table[i].inUse) {
             char type = table[i].isDir ? 'D' : 'F';
@@ -194,6 +444,7 @@ void Directory::RecursiveList() {
     Directory *subDirectory = new Directory(NumDirEntries);	
 	OpenFile *tempOpenFile;
 
+    LoadAll();
     for (int i = 0; i < tableSize; i++) {
         if (table[i].inUse) {
             char type = table[i].isDir ? 'D' : 'F';
@@ -219,6 +470,7 @@ Directory::Print()
 { 
     FileHeader *hdr = new FileHeader;
 
+    LoadAll();
     printf("Directory contents:\n");
     for (int i = 0; i < tableSize; i++)
 	if (table[i].inUse) {
@@ -19,12 +19,16 @@
 
 #include "openfile.h"
 
-#define FileNameMaxLen 		9	// for simplicity, we assume 
-					// file names are <= 9 characters long
+#define FileNameMaxLen 		55	// for simplicity, we assume 
+					// file names are <= 55 characters long
+#define NumDirEntries 		8	// # of entries a new directory has
+					// room for, before it has to grow;
+					// a power of 2
 
 // The following class defines a "directory entry", representing a file
 // in the directory.  Each entry gives the name of the file, and where
-// the file's header is to be found on disk.
+// the file's header is to be found on disk.  An entry is 64 bytes, so
+// that a disk sector holds a whole number of them.
 //
 // Internal data structures kept public so that Directory operations can
 // access them directly.
@@ -33,21 +37,48 @@ class DirectoryEntry {
   public:
     bool inUse;				// Is this directory entry in use?
     bool isDir;
+    bool removed;			// Was it in use, before the file
+					// was removed?  (Lookups have to
+					// keep looking past it.)
     int sector;				// Location on disk to find the 
 					//   FileHeader for this file 
     char name[FileNameMaxLen + 1];	// Text name for file, with +1 for 
 					// the trailing '\0'
 };
 
+// What a directory file holds, ahead of its table of entries.  It takes
+// up the space of one entry.
+
+class DirectoryHeader {
+  public:
+    int tableSize;			// # of entries in the table
+    int numInUse;			// # of them in use
+    int numRemoved;			// # of them marked "removed"
+};
+
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
+// The entries are kept in a hash table on the file name, with open
+// addressing: a name goes in the first free entry at or after the one
+// it hashes to.  When the table gets three quarters full (counting the
+// entries of removed files, which lookups have to step over), it is
+// rebuilt at twice the size, so the directory can hold any number of
+// files, and finding a name only takes a look at an entry or two.
+//
 // The directory data structure can be stored in memory, or on disk.
-// When it is on disk, it is stored as a regular Nachos file.
+// When it is on disk, it is stored as a regular Nachos file: the
+// DirectoryHeader, followed by the table.  FetchFrom only reads the
+// header; the entries are read a sector at a time, as lookups need them,
+// so looking up a name in a big directory doesn't read all of it.  Only
+// the sectors that changed are written back.  The file has to stay open
+// for as long as entries might be read from it.
 //
 // The constructor initializes a directory structure in memory; the
 // FetchFrom/WriteBack operations shuffle the directory information
-// from/to disk. 
+// from/to disk.  Since a directory that has grown needs a bigger file,
+// the caller makes sure the file is at least FileLength bytes long
+// before calling WriteBack.
 
 class Directory {
   public:
@@ -58,6 +89,8 @@ class Directory {
     void FetchFrom(OpenFile *file);  	// Init directory contents from disk
     void WriteBack(OpenFile *file);	// Write modifications to 
 					// directory contents back to disk
+    int FileLength();			// # of bytes the directory takes
+					// on disk
 
     int Find(char *name);		// Find the sector number of the 
 					// FileHeader for file: "name"
@@ -76,7 +109,7 @@ class Directory {
 					//  names and their contents.
 
     ///
-    DirectoryEntry* GetTable() { return table; }
+    DirectoryEntry* GetTable() { LoadAll(); return table; }
     int GetTableSize() { return tableSize; }
     ///   
 
@@ -85,16 +118,32 @@ class Directory {
 	/*
 		MP4 Hint:
 		Directory is actually a "file", be careful of how it works with OpenFile and FileHdr.
-		Disk part: table
-		In-core part: tableSize
+		Disk part: tableSize, numInUse, numRemoved, table
+		In-core part: openFile, loaded, dirty, allDirty
 	*/
   
-    int tableSize;			// Number of directory entries
+    int tableSize;			// Number of directory entries;
+					// a power of 2
     DirectoryEntry *table;		// Table of pairs: 
 					// <file name, file header location> 
+    int numInUse;			// # of entries in use
+    int numRemoved;			// # of entries marked "removed"
+
+    OpenFile *openFile;			// where to read entries from, or
+					// NULL if they are all in memory
+    bool *loaded;			// which sectors of the file have
+					// been read, and
+    bool *dirty;			// which have changed since
+    bool allDirty;			// write the whole file back?
 
     int FindIndex(char *name);		// Find the index into the directory 
 					//  table corresponding to "name"
+    unsigned Hash(char *name);		// Where to start looking for "name"
+    void Init(int size);		// Make an empty table of "size"
+    void Load(int index);		// Make sure an entry has been read
+    void LoadAll();			// Make sure they all have been read
+    void SetDirty(int index);		// Note that an entry has changed
+    void Resize(int newSize);		// Rebuild the table at "newSize"
 };
 
 #endif // DIRECTORY_H
@@ -3,12 +3,24 @@
 //	would be called the i-node).
 //
 //	The file header is used to locate where on disk the 
-//	file's data is stored.  We implement this as a fixed size
-//	table of pointers -- each entry in the table points to the 
-//	disk sector containing that portion of the file data
-//	(in other words, there are no indirect or doubly indirect 
-//	blocks). The table size is chosen so that the file header
-//	will be just big enough to fit in one disk sector, 
+//	file's data is stored.  We implement this as a table of
+//	extents -- each entry in the table gives a run of consecutive
+//	disk sectors holding that portion of the file data.  Data is
+//	allocated in runs as long as the free space allows, so that
+//	reading a file sequentially mostly reads consecutive sectors.
+//	If a file has too many extents to fit in the header, they are
+//	kept in a tree of "extent blocks", each one sector in size,
+//	which the header points to.
+//
+//	Files can be sparse: a part of the file that has never been
+//	written need not have any sectors allocated for it.  Such a
+//	"hole" is simply a gap between extents (or after the last one),
+//	and reads as zeros.  Sectors are allocated for a hole when it is
+//	written (see Fill).
+//
+//	A small file (most of them) has no extents: its data is kept in
+//	the header sector itself, in their place.  It takes no sectors
+//	besides its header, and is read along with it.
 //
 //      Unlike in a real system, we do not keep track of file permissions, 
 //	ownership, last modification date, etc., in the file header. 
@@ -29,6 +41,33 @@
 #include "synchdisk.h"
 #include "main.h"
 
+//----------------------------------------------------------------------
+// ReadBlock/WriteBlock
+// 	Read or write an extent block, which takes up one disk sector.
+//
+//	"sector" is the disk sector containing the extent block
+//	"block" is the in-memory copy
+//----------------------------------------------------------------------
+
+static void
+ReadBlock(int sector, ExtentBlock *block)
+{
+    char buf[SectorSize];
+
+    kernel->synchDisk->ReadSector(sector, buf);
+    memcpy(block, buf, sizeof(ExtentBlock));
+}
+
+static void
+WriteBlock(int sector, ExtentBlock *block)
+{
+    char buf[SectorSize];
+
+    memset(buf, 0, SectorSize);
+    memcpy(buf, block, sizeof(ExtentBlock));
+    kernel->synchDisk->WriteSector(sector, buf);
+}
+
 //----------------------------------------------------------------------
 // MP4 mod tag
 // FileHeader::FileHeader
@@ -39,20 +78,24 @@
 FileHeader::FileHeader()
 {
 	numBytes = -1;
-	numSectors = -1;
-	memset(dataSectors, -1, sizeof(dataSectors));
+	depth = 0;
+	numExtents = 0;
+	memset(extents, -1, sizeof(extents));
+	memset(inlineData, 0, sizeof(inlineData));
+	leaves = NULL;
+	numLeaves = 0;
+	lastLeaf = 0;
 }
 
 //----------------------------------------------------------------------
 // MP4 mod tag
 // FileHeader::~FileHeader
-//	Currently, there is not need to do anything in destructor function.
-//	However, if you decide to add some "in-core" data in header
-//	Always remember to deallocate their space or you will leak memory
+//	Free the in-core copy of the extent tree, if any.
 //----------------------------------------------------------------------
 FileHeader::~FileHeader()
 {
-	// nothing to do now
+	if (leaves != NULL)
+		delete [] leaves;
 }
 
 //----------------------------------------------------------------------
@@ -62,86 +105,480 @@ FileHeader::~FileHeader()
 //	Return FALSE if there are not enough free blocks to accomodate
 //	the new file.
 //
+//	The data is allocated in runs of free sectors that are as long
+//	as possible, ideally one run for the whole file.  If there are
+//	more runs than fit in the header, we build a tree of extent
+//	blocks over them, from the bottom up, until the top level fits.
+//
 //	"freeMap" is the bit map of free disk sectors
 //	"fileSize" is the bit map of free disk sectors
 //----------------------------------------------------------------------
 
-void FileHeader::MultiLayerAlloc(PersistentBitmap *freeMap, int fileSize, int maxFileSize) {
-	int i = 0;
-	for (i = 0; i < numSectors; i++) {
-		dataSectors[i] = freeMap->FindAndSet();
-		FileHeader *subHdr = new FileHeader;
+bool
+FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
+{ 
+    int numSectors = divRoundUp(fileSize, SectorSize);
+    int count = 0, size = NumHeaderExtents;
+    Extent *table;
+
+    numBytes = fileSize;
+    depth = 0;
+    numExtents = 0;
+    if (leaves != NULL) {
+	delete [] leaves;
+	leaves = NULL;
+    }
+    lastLeaf = 0;
+    if (freeMap->NumClear() < numSectors) {
+	return FALSE;		// not enough space
+    }
 
-		int nextStorageSize;
-		if (fileSize >= maxFileSize) {
-			nextStorageSize = maxFileSize;
-		} else {
-			nextStorageSize = fileSize;
-		}
-		subHdr->Allocate(freeMap, nextStorageSize);
-		fileSize -= nextStorageSize;
-		subHdr->WriteBack(dataSectors[i]);
+    table = new Extent[size];
+    AllocateRuns(freeMap, &table, &count, &size, 0, numSectors, 0);
+    DEBUG(dbgFile, "Allocated " << numSectors << " sectors in " << count
+				<< " extents");
+    return BuildTree(freeMap, table, count);
+}
 
-		if (fileSize <= 0) break;
-	}
-	numSectors = i+1; // Real allocated num
+//----------------------------------------------------------------------
+// FileHeader::AllocateSparse
+// 	Initialize a fresh file header for a newly created file, without
+//	allocating any data blocks: the whole file is one hole, and
+//	sectors are allocated as the file is written.  Creating even a
+//	very large file then only costs writing its header.  A file small
+//	enough starts out with its data (all zeros) in the header.
+//
+//	"fileSize" is the length of the new file, in bytes
+//----------------------------------------------------------------------
+
+void
+FileHeader::AllocateSparse(int fileSize)
+{
+    numBytes = fileSize;
+    depth = (fileSize <= MaxInlineBytes) ? InlineDepth : 0;
+    numExtents = 0;
+    memset(inlineData, 0, sizeof(inlineData));
+    if (leaves != NULL) {
+	delete [] leaves;
+	leaves = NULL;
+    }
+    lastLeaf = 0;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::Extend
+// 	Make the file bigger, allocating data blocks for all of the new
+//	part of it (see Fill).  Return FALSE if there are not enough free
+//	blocks, leaving the header as it was.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"newSize" is the new length of the file, in bytes
+//----------------------------------------------------------------------
+
 bool
-FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
-{ 
-	numBytes = fileSize;
-	int totalSectors = divRoundUp(fileSize, SectorSize);
-	numSectors = totalSectors > NumDirect ? NumDirect : totalSectors; // numSectors only contains this directory sector number
-	if (freeMap->NumClear() < numSectors) return FALSE;		// not enough space
-
-	
-	if (fileSize > MaxFileSize3) {
-		// need 4 layers to memory => 64 MB
-		MultiLayerAlloc(freeMap, fileSize, MaxFileSize3);
-	}
-	else if (fileSize > MaxFileSize2) {
-		// need 3 layers to memory => 4 MB
-		MultiLayerAlloc(freeMap, fileSize, MaxFileSize2);
+FileHeader::Extend(PersistentBitmap *freeMap, int newSize)
+{
+    if (newSize <= numBytes) {
+	return TRUE;
+    }
+    return Fill(freeMap, numBytes, newSize - numBytes);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Fill
+// 	Allocate data blocks for the part of the file about to be
+//	written, wherever it falls in a hole, and make the file longer if
+//	it goes past the end.  A hole is filled starting right after the
+//	run on disk before it, if those sectors are free, and otherwise
+//	in runs as long as possible, as in Allocate; the tree of extent
+//	blocks is then built again over the new set of runs.  Return
+//	FALSE if there are not enough free blocks, leaving the header as
+//	it was.
+//
+//	A file written sequentially is usually written some more, so when
+//	a write carries on from the allocated part of the file before it,
+//	sectors are allocated ahead, past the end of the write, to make
+//	that part about twice as long, as long as they fall in the same
+//	hole, and no more than a track's worth.  That keeps a file written
+//	a little at a time (a log, say) in long runs, even if other files
+//	are being written at the same time, without many trips to the
+//	bitmap.  This is only done when the write makes the file longer,
+//	so that the sectors allocated ahead are past its end; they stay
+//	with the file, and are used by later writes (which clear any of
+//	them left in a gap, see OpenFile::WriteAt).
+//
+//	Inside the file (one created large, say), sectors allocated ahead
+//	would be read as part of it, and they are not cleared; so there,
+//	the write is only put where there is room after it for as many
+//	sectors as would have been allocated ahead, and later writes can
+//	carry on into them, if they are still free.
+//
+//	A file with its data in the header keeps it there as long as the
+//	data fits; once the file grows too big, the data is moved out to
+//	a sector of its own.  Only that sector and the ones being written
+//	are allocated; any gap between them is left as a hole.
+//
+//	As with Allocate, only the in-memory header changes; the caller
+//	writes it back, along with the bitmap (or reverts the bitmap, if
+//	there was no room).
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"position" and "length" give the bytes of the file to be written
+//----------------------------------------------------------------------
+
+bool
+FileHeader::Fill(PersistentBitmap *freeMap, int position, int length)
+{
+    int fromSector = divRoundDown(position, SectorSize);
+    int toSector = divRoundUp(position + length, SectorSize);
+    bool wasInline = (depth == InlineDepth), built;
+    bool moveApart = FALSE;
+    int oldCount, count, size, needed, ahead, room, sector, end, i;
+    Extent *old, *table;
+    char buf[SectorSize];
+
+    if (wasInline) {
+	if (position + length <= MaxInlineBytes) {	// still fits
+	    numBytes = max(numBytes, position + length);
+	    return TRUE;
 	}
-	else if (fileSize > MaxFileSize1) {
-		// need 2 layers to memory => 64 KB
-		MultiLayerAlloc(freeMap, fileSize, MaxFileSize1);
+	// the old data needs a sector too, apart from the write's, unless
+	// the write starts in it
+	moveApart = (numBytes > 0 && fromSector > 0);
+    }
+    if (depth > 0 && leaves == NULL) {
+	LoadLeaves();
+    }
+    old = (depth > 0) ? leaves : extents;
+    oldCount = (depth > 0) ? numLeaves : numExtents;
+
+    // count the sectors of the range that are in holes
+    needed = moveApart ? 1 : 0;
+    for (sector = fromSector; sector < toSector; sector = end) {
+	i = FindExtent(old, oldCount, sector);
+	if (i >= 0) {
+	    end = old[i].fileSector + old[i].length;
 	} else {
-		// need 1 layers to memory => 4 KB
-		for (int i = 0; i < numSectors; i++) {
-			dataSectors[i] = freeMap->FindAndSet();
-
-			// since we checked that there was enough free space,
-			// we expect this to succeed
-			ASSERT(dataSectors[i] >= 0);
-		}
+	    i = -1 - i;			// the next extent, if any
+	    end = (i < oldCount) ? min(old[i].fileSector, toSector) : toSector;
+	    needed += end - sector;
+	}
+    }
+    if (needed == 0) {			// allocated already
+	numBytes = max(numBytes, position + length);
+	return TRUE;
+    }
+
+    // allocate ahead, if the write carries on from the allocated part
+    // of the file before it, and ends in a hole
+    ahead = 0;
+    if (fromSector > 0 && (i = FindExtent(old, oldCount, fromSector - 1)) >= 0
+		&& (end = FindExtent(old, oldCount, toSector)) < 0) {
+	for (sector = old[i].fileSector; i > 0 && old[i - 1].fileSector
+		    + old[i - 1].length == old[i].fileSector; i--) {
+	    sector = old[i - 1].fileSector;	// where that part starts
+	}
+	ahead = max(2 * fromSector - sector - toSector, 0);
+	end = -1 - end;
+	if (end < oldCount) {		// no further than the next extent
+	    ahead = min(ahead, old[end].fileSector - toSector);
+	}
+	if (toSector * SectorSize < numBytes) {	// or the end of the file
+	    ahead = min(ahead, divRoundUp(numBytes, SectorSize) - toSector);
+	} else {			// or a track past it
+	    ahead = min(ahead, SectorsPerTrack);
+	}
+    }
+    room = 0;
+    if (position + length <= numBytes) {	// inside the file
+	room = ahead;
+	ahead = 0;
+    }
+    if (freeMap->NumClear() < needed + ahead
+			+ BlocksNeeded(oldCount + needed + ahead)) {
+	ahead = 0;			// no room to allocate ahead
+    }
+    if (freeMap->NumClear() < needed) {
+	return FALSE;		// not enough space
+    }
+    toSector += ahead;
+
+    // merge the old extents with runs for the holes
+    size = max(2 * oldCount, (int) NumHeaderExtents);
+    table = new Extent[size];
+    count = 0;
+    if (moveApart) {			// a file in the header has no extents
+	AllocateRuns(freeMap, &table, &count, &size, 0, 1, 0);
+    }
+    sector = fromSector;
+    for (i = 0; i < oldCount; i++) {
+	if (sector < min(old[i].fileSector, toSector)) {
+	    AllocateRuns(freeMap, &table, &count, &size, sector,
+				min(old[i].fileSector, toSector),
+				(old[i].fileSector >= toSector) ? room : 0);
+	}
+	*NewExtent(&table, &count, &size) = old[i];
+	sector = max(sector, old[i].fileSector + old[i].length);
+    }
+    if (sector < toSector) {
+	AllocateRuns(freeMap, &table, &count, &size, sector, toSector, room);
+    }
+    DEBUG(dbgFile, "Filled " << needed + ahead << " sectors from "
+			<< fromSector << ", " << count << " extents");
+
+    // the blocks of the old tree are freed before the new tree is
+    // built, so that it can use them -- on a nearly full disk, there
+    // may not be room for both at once
+    if (freeMap->NumClear() + BlocksNeeded(oldCount) < BlocksNeeded(count)) {
+	delete [] table;
+	return FALSE;		// no room for the extent blocks
+    }
+    FreeBlocks(freeMap, extents, numExtents, depth);
+    built = BuildTree(freeMap, table, count);
+    ASSERT(built);			// there was room, checked above
+    if (wasInline && numBytes > 0) {	// move the data out of the header
+	memset(buf, 0, SectorSize);
+	memcpy(buf, inlineData, numBytes);
+	kernel->synchDisk->WriteSector(ByteToSector(0), buf);
+    }
+    numBytes = max(numBytes, position + length);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocateRuns
+// 	Allocate the data blocks for a range of sectors of the file,
+//	appending their extents to a table.  If the last extent in the
+//	table ends where the range starts, it is lengthened while the disk
+//	sector after it is free; after that, the sectors are allocated in
+//	runs as long as possible.  The caller has already checked that
+//	there are enough free blocks.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"table", "count" and "size" give the table of extents, which is
+//		made bigger as need be
+//	"fromSector" and "toSector" give the range of file sectors
+//	"room" is the # of free sectors wanted after the last run, for
+//		later writes to carry on into (they are left free)
+//----------------------------------------------------------------------
+
+void
+FileHeader::AllocateRuns(PersistentBitmap *freeMap, Extent **table,
+			int *count, int *size, int fromSector, int toSector,
+			int room)
+{
+    int fileSector = fromSector, length;
+
+    if (*count > 0) {
+	Extent *last = &(*table)[*count - 1];
+
+	ASSERT(last->fileSector + last->length <= fromSector);
+	while (fileSector < toSector && last->fileSector + last->length
+			== fileSector && last->start + last->length < NumSectors
+			&& !freeMap->Test(last->start + last->length)) {
+	    freeMap->Mark(last->start + last->length);
+	    last->length++;
+	    fileSector++;
+	}
+    }
+    for (; fileSector < toSector; fileSector += length) {
+	Extent *extent = NewExtent(table, count, size);
+
+	extent->fileSector = fileSector;
+	extent->start = freeMap->FindAndSetRun(toSector - fileSector + room,
+								&length);
+
+	// since the caller checked that there was enough free space,
+	// we expect this to succeed
+	ASSERT(extent->start >= 0);
+	for (; length > toSector - fileSector; length--) {
+	    freeMap->Clear(extent->start + length - 1);	// leave the room
+	}
+	extent->length = length;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::NewExtent
+// 	Add an entry to the end of a table of extents, and return it.
+//
+//	"table", "count" and "size" give the table of extents; if it is
+//		full, it is replaced by one twice the size
+//----------------------------------------------------------------------
+
+Extent *
+FileHeader::NewExtent(Extent **table, int *count, int *size)
+{
+    if (*count == *size) {		// out of room; double the table
+	Extent *bigger = new Extent[2 * *size];
+	memcpy(bigger, *table, *size * sizeof(Extent));
+	delete [] *table;
+	*table = bigger;
+	*size *= 2;
+    }
+    return &(*table)[(*count)++];
+}
+
+//----------------------------------------------------------------------
+// FileHeader::BuildTree
+// 	Make a table of data extents the contents of the header: if there
+//	are more than fit in the header, we build a tree of extent blocks
+//	over them, from the bottom up, until the top level fits.  Return
+//	FALSE if there is no room on disk for the extent blocks, leaving
+//	the extents in the header as they were.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"table" and "count" give the extents, in order of fileSector;
+//		the table is deleted when we are done with it
+//----------------------------------------------------------------------
+
+bool
+FileHeader::BuildTree(PersistentBitmap *freeMap, Extent *table, int count)
+{
+    int levels = 0;
+
+    if (leaves != NULL) {
+	delete [] leaves;
+	leaves = NULL;
+    }
+    lastLeaf = 0;
+    if (count > (int) NumHeaderExtents) {	// keep the bottom level
+	leaves = new Extent[count];		// for ByteToSector
+	memcpy(leaves, table, count * sizeof(Extent));
+	numLeaves = count;
+    }
+
+    while (count > (int) NumHeaderExtents) {	// add a level of blocks
+	int numBlocks = divRoundUp(count, NumBlockExtents);
+	Extent *parent = new Extent[numBlocks];
+	ExtentBlock block;
+
+	for (int i = 0; i < numBlocks; i++) {
+	    Extent *first = &table[i * NumBlockExtents];
+
+	    memset(&block, 0, sizeof(block));
+	    block.numExtents = min((int) NumBlockExtents,
+					count - i * (int) NumBlockExtents);
+	    memcpy(block.extents, first, block.numExtents * sizeof(Extent));
+	    parent[i].fileSector = first->fileSector;
+	    parent[i].length = first[block.numExtents - 1].fileSector
+		+ first[block.numExtents - 1].length - first->fileSector;
+	    parent[i].start = freeMap->FindAndSet();
+	    if (parent[i].start == -1) {	// no room for the block
+		delete [] parent;
+		delete [] table;
+		delete [] leaves;
+		leaves = NULL;
+		return FALSE;
+	    }
+	    WriteBlock(parent[i].start, &block);
 	}
+	delete [] table;
+	table = parent;
+	count = numBlocks;
+	levels++;
+    }
+    depth = levels;
+    numExtents = count;
+    memcpy(extents, table, count * sizeof(Extent));
+    delete [] table;
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::BlocksNeeded
+// 	Return how many extent blocks BuildTree needs, to build the tree
+//	over a table of extents.
+//
+//	"count" is the # of extents in the table
+//----------------------------------------------------------------------
+
+int
+FileHeader::BlocksNeeded(int count)
+{
+    int blocks = 0;
+
+    while (count > (int) NumHeaderExtents) {
+	count = divRoundUp(count, NumBlockExtents);
+	blocks += count;
+    }
+    return blocks;
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
-// 	De-allocate all the space allocated for data blocks for this file.
+// 	De-allocate all the space allocated for data blocks for this file,
+//	and for its extent blocks.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+void
+FileHeader::Deallocate(PersistentBitmap *freeMap)
+{
+    if (depth == InlineDepth) {
+	return;			// nothing but the header
+    }
+    FreeTree(freeMap, extents, numExtents, depth);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FreeTree
+// 	De-allocate the sectors described by a table of extents: the
+//	data sectors, if "level" is 0; otherwise, the extent blocks in
+//	the table, and everything under them.
 //
 //	"freeMap" is the bit map of free disk sectors
+//	"table" and "count" give the extents
+//	"level" is the # of levels of extent blocks below "table"
 //----------------------------------------------------------------------
-void FileHeader::Deallocate(PersistentBitmap *freeMap)
+
+void
+FileHeader::FreeTree(PersistentBitmap *freeMap, Extent *table, int count,
+			int level)
 {
-	if (numBytes > MaxFileSize1) {
-		// MaxFileSize1, MaxFileSize2, MaxFileSize3 are all need to go through it.
-		for (int i = 0; i < numSectors; i++){
-			DEBUG('f', "free: " << dataSectors[i]);
-			FileHeader *subhdr = new FileHeader;
-			subhdr->FetchFrom(dataSectors[i]);
-			subhdr->Deallocate(freeMap);
-		}
+    ExtentBlock block;
+
+    for (int i = 0; i < count; i++) {
+	if (level == 0) {
+	    for (int j = 0; j < table[i].length; j++) {
+		ASSERT(freeMap->Test(table[i].start + j));  // ought to be marked!
+		freeMap->Clear(table[i].start + j);
+	    }
 	} else {
-		for (int i = 0; i < numSectors; i++) {
-			ASSERT(freeMap->Test((int) dataSectors[i]));  // ought to be marked!
-			freeMap->Clear((int) dataSectors[i]);
-		}
+	    ReadBlock(table[i].start, &block);
+	    FreeTree(freeMap, block.extents, block.numExtents, level - 1);
+	    ASSERT(freeMap->Test(table[i].start));
+	    freeMap->Clear(table[i].start);
 	}
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FreeBlocks
+// 	De-allocate the extent blocks of a subtree, but not the data
+//	sectors they describe.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"table" and "count" give the extents
+//	"level" is the # of levels of extent blocks below "table"
+//----------------------------------------------------------------------
+
+void
+FileHeader::FreeBlocks(PersistentBitmap *freeMap, Extent *table, int count,
+			int level)
+{
+    ExtentBlock block;
+
+    if (level <= 0) {
+	return;
+    }
+    for (int i = 0; i < count; i++) {
+	ReadBlock(table[i].start, &block);
+	FreeBlocks(freeMap, block.extents, block.numExtents, level - 1);
+	ASSERT(freeMap->Test(table[i].start));
+	freeMap->Clear(table[i].start);
+    }
 }
 
 //----------------------------------------------------------------------
@@ -154,13 +591,23 @@ void FileHeader::Deallocate(PersistentBitmap *freeMap)
 void
 FileHeader::FetchFrom(int sector)
 {
-    kernel->synchDisk->ReadSector(sector, (char *)this);
-	
-	/*
-		MP4 Hint:
-		After you add some in-core informations, you will need to rebuild the header's structure
-	*/
-	
+    char buf[SectorSize];
+
+    kernel->synchDisk->ReadSector(sector, buf);
+    memcpy(&numBytes, buf, sizeof(int));
+    memcpy(&depth, buf + sizeof(int), sizeof(int));
+    if (depth == InlineDepth) {		// the data is all there is
+	numExtents = 0;
+	memcpy(inlineData, buf + 2 * sizeof(int), MaxInlineBytes);
+    } else {
+	memcpy(&numExtents, buf + 2 * sizeof(int), sizeof(int));
+	memcpy(extents, buf + 3 * sizeof(int), sizeof(extents));
+    }
+    if (leaves != NULL) {		// the tree is loaded when needed
+	delete [] leaves;
+	leaves = NULL;
+    }
+    lastLeaf = 0;
 }
 
 //----------------------------------------------------------------------
@@ -173,17 +620,47 @@ FileHeader::FetchFrom(int sector)
 void
 FileHeader::WriteBack(int sector)
 {
-    kernel->synchDisk->WriteSector(sector, (char *)this); 
-	
-	/*
-		MP4 Hint:
-		After you add some in-core informations, you may not want to write all fields into disk.
-		Use this instead:
-		char buf[SectorSize];
-		memcpy(buf + offset, &dataToBeWritten, sizeof(dataToBeWritten));
-		...
-	*/
-	
+    char buf[SectorSize];
+
+    memset(buf, 0, SectorSize);
+    memcpy(buf, &numBytes, sizeof(int));
+    memcpy(buf + sizeof(int), &depth, sizeof(int));
+    if (depth == InlineDepth) {
+	memcpy(buf + 2 * sizeof(int), inlineData, MaxInlineBytes);
+    } else {
+	memcpy(buf + 2 * sizeof(int), &numExtents, sizeof(int));
+	memcpy(buf + 3 * sizeof(int), extents, sizeof(extents));
+    }
+    kernel->synchDisk->WriteSector(sector, buf); 
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FindExtent
+// 	Binary search a table of extents, sorted by fileSector, for the
+//	one covering a sector of the file.  Return its index; or, if the
+//	sector is in a hole, -1 - the index of the first extent after it
+//	(which is "count", if there is none).
+//
+//	"table" and "count" give the extents
+//	"fileSector" is the sector of the file to look for
+//----------------------------------------------------------------------
+
+int
+FileHeader::FindExtent(Extent *table, int count, int fileSector)
+{
+    int low = 0, high = count - 1, mid;
+
+    while (low <= high) {
+	mid = (low + high) / 2;
+	if (fileSector < table[mid].fileSector) {
+	    high = mid - 1;
+	} else if (fileSector >= table[mid].fileSector + table[mid].length) {
+	    low = mid + 1;
+	} else {
+	    return mid;
+	}
+    }
+    return -1 - low;
 }
 
 //----------------------------------------------------------------------
@@ -191,25 +668,132 @@ FileHeader::WriteBack(int sector)
 // 	Return which disk sector is storing a particular byte within the file.
 //      This is essentially a translation from a virtual address (the
 //	offset in the file) to a physical address (the sector where the
-//	data at the offset is stored).
+//	data at the offset is stored).  Return -1 if the byte is in a
+//	hole, with no sector allocated for it.
+//
+//	"offset" is the location within the file of the byte in question
+//----------------------------------------------------------------------
+
+int
+FileHeader::ByteToSector(int offset)
+{
+    int fileSector = offset / SectorSize;
+    Extent *table = extents;
+    int count = numExtents;
+    int i = lastLeaf;
+
+    ASSERT(depth != InlineDepth);	// no sectors to find
+    if (depth > 0) {
+	if (leaves == NULL) {
+	    LoadLeaves();
+	}
+	table = leaves;
+	count = numLeaves;
+    }
+    if (i >= count || fileSector < table[i].fileSector
+		|| fileSector >= table[i].fileSector + table[i].length) {
+	i = FindExtent(table, count, fileSector);
+	if (i < 0) {
+	    return -1;			// in a hole
+	}
+	lastLeaf = i;
+    }
+    return table[i].start + (fileSector - table[i].fileSector);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::SectorsInRun
+// 	Return how many sectors of the file, starting with the one holding
+//	a particular byte, are stored in consecutive disk sectors -- that
+//	is, the rest of its extent.  They can be read or written to disk
+//	in one request.  If the byte is in a hole, return how many sectors
+//	of the hole are left, instead.
 //
 //	"offset" is the location within the file of the byte in question
 //----------------------------------------------------------------------
 
-int FileHeader::PerByteToSectorCalc(int offset, int maxFileSize) {
-	int which = -1;
-	which = divRoundDown(offset, maxFileSize);
-	FileHeader *subhdr = new FileHeader;
-	subhdr->FetchFrom(dataSectors[which]);
-	return subhdr->ByteToSector(offset - maxFileSize*which);
+int
+FileHeader::SectorsInRun(int offset)
+{
+    int fileSector = offset / SectorSize;
+    int sector = ByteToSector(offset);	// loads the leaves, if need be
+    Extent *table = (depth > 0) ? leaves : extents;
+    int count = (depth > 0) ? numLeaves : numExtents;
+    int next;
+
+    if (sector == -1) {
+	next = -1 - FindExtent(table, count, fileSector);
+	if (next < count) {
+	    return table[next].fileSector - fileSector;
+	}
+	return max(divRoundUp(numBytes, SectorSize) - fileSector, 1);
+    }
+    // otherwise, ByteToSector left the extent in lastLeaf
+    return table[lastLeaf].fileSector + table[lastLeaf].length - fileSector;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::LoadLeaves
+// 	Read in the extent blocks under the header, and keep the extents
+//	at the bottom of the tree -- the ones that describe the data --
+//	in memory, so that ByteToSector doesn't need to go to disk.
+//	The extent blocks are only read the first time they are needed,
+//	and are kept for as long as this header is.
+//----------------------------------------------------------------------
+
+void
+FileHeader::LoadLeaves()
+{
+    int size = numExtents;
+
+    for (int level = 0; level < depth; level++) {
+	size *= NumBlockExtents;	// the most there could be
+    }
+    leaves = new Extent[size];
+    numLeaves = 0;
+    CollectTree(extents, numExtents, depth, leaves, &numLeaves);
+    DEBUG(dbgFile, "Loaded " << numLeaves << " extents, depth " << depth);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::CollectTree
+// 	Append the data extents under a table of extents to "leaves",
+//	in order of fileSector.
+//
+//	"table" and "count" give the extents
+//	"level" is the # of levels of extent blocks below "table"
+//	"leaves" and "numLeaves" are where to put them
+//----------------------------------------------------------------------
+
+void
+FileHeader::CollectTree(Extent *table, int count, int level,
+			Extent *leaves, int *numLeaves)
+{
+    ExtentBlock block;
+
+    if (level == 0) {
+	memcpy(&leaves[*numLeaves], table, count * sizeof(Extent));
+	*numLeaves += count;
+	return;
+    }
+    for (int i = 0; i < count; i++) {
+	ReadBlock(table[i].start, &block);
+	CollectTree(block.extents, block.numExtents, level - 1,
+			leaves, numLeaves);
+    }
 }
 
-int FileHeader::ByteToSector(int offset)
+//----------------------------------------------------------------------
+// FileHeader::InlineData
+// 	Return the file's data, if it is small enough to be kept in the
+//	header, or else NULL.  The data can be read or written in place;
+//	a change is written to disk along with the header.
+//----------------------------------------------------------------------
+
+char *
+FileHeader::InlineData()
 {
-	if (numBytes > MaxFileSize3) return PerByteToSectorCalc(offset, MaxFileSize3);
-	else if (numBytes > MaxFileSize2) return PerByteToSectorCalc(offset, MaxFileSize2);
-	else if (numBytes > MaxFileSize1) return PerByteToSectorCalc(offset, MaxFileSize1);
-    return (dataSectors[offset / SectorSize]);
+    return (depth == InlineDepth) ? inlineData : NULL;
 }
 
 //----------------------------------------------------------------------
@@ -223,43 +807,66 @@ FileHeader::FileLength()
     return numBytes;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::PrintTree
+// 	Print the extents in a table, and (if they are extent blocks)
+//	the extents under them.
+//
+//	"table" and "count" give the extents
+//	"level" is the # of levels of extent blocks below "table"
+//----------------------------------------------------------------------
+
+void
+FileHeader::PrintTree(Extent *table, int count, int level)
+{
+    ExtentBlock block;
+
+    for (int i = 0; i < count; i++) {
+	if (level == 0) {
+	    printf("%d-%d ", table[i].start, 
+				table[i].start + table[i].length - 1);
+	} else {
+	    printf("[block %d: ", table[i].start);
+	    ReadBlock(table[i].start, &block);
+	    PrintTree(block.extents, block.numExtents, level - 1);
+	    printf("] ");
+	}
+    }
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Print
 // 	Print the contents of the file header, and the contents of all
 //	the data blocks pointed to by the file header.
 //----------------------------------------------------------------------
 
-void FileHeader::PerMutiPrint() {
-	for (int i = 0; i < numSectors; i++){
-		printf("this level hdr: %d\n", dataSectors[i]);
-		OpenFile *openfile = new OpenFile(dataSectors[i]);
-		FileHeader *subhdr = openfile->getHdr();
-		subhdr->Print();
-	}
-}
+void
+FileHeader::Print()
+{
+    int i, j, k;
+    int numSectors = divRoundUp(numBytes, SectorSize);
+    char *data = new char[SectorSize];
 
-void FileHeader::Print() {
     printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
-	if (numBytes > MaxFileSize1) {
-		// MaxFileSize1, MaxFileSize2, MaxFileSize3 are all need to go through it.
-		PerMutiPrint();
+    PrintTree(extents, numExtents, depth);
+
+    printf("\nFile contents:\n");
+    for (i = k = 0; i < numSectors; i++) {
+	if (depth == InlineDepth) {
+	    memcpy(data, inlineData, numBytes);	// in the header
+	} else if (ByteToSector(i * SectorSize) == -1) {
+	    memset(data, 0, SectorSize);	// a hole
 	} else {
-		int i, j, k;
-    	char *data = new char[SectorSize];
-		for (i = 0; i < numSectors; i++) printf("%d ", dataSectors[i]);
-
-		printf("\nFile contents:\n");
-		for (i = k = 0; i < numSectors; i++) {
-			kernel->synchDisk->ReadSector(dataSectors[i], data);
-			for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++) {
-				if ('\040' <= data[j] && data[j] <= '\176'){  // isprint(data[j])
-					printf("%c", data[j]);
-				} else {
-					printf("\\%x", (unsigned char)data[j]);
-				}
-			}
-			printf("\n"); 
-		}
-		delete [] data;
+	    kernel->synchDisk->ReadSector(ByteToSector(i * SectorSize), data);
+	}
+	for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++) {
+	    if ('\040' <= data[j] && data[j] <= '\176') {  // isprint(data[j])
+		printf("%c", data[j]);
+	    } else {
+		printf("\\%x", (unsigned char)data[j]);
+	    }
 	}
+	printf("\n"); 
+    }
+    delete [] data;
 }
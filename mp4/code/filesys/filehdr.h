@@ -17,30 +17,54 @@
 #include "disk.h"
 #include "pbitmap.h"
 
-#define NumDirect 	((SectorSize - 2 * sizeof(int)) / sizeof(int))
-
-/**
- * In original view
- * MaxFileSize1 means only one layer file header -> 2^(5+7) = 4KB
- * MaxFileSize2 means two layer file headers -> 2^(5+5+7) = 64KB
- * MaxFileSize3 means three layer file headers -> 2^(5+5+5+7) = 4 MB
- * MaxFileSize4 means four layer file headers -> 2^(5+5+5+5+7) = 64 MB
- **/
-#define MaxFileSize1	(NumDirect * SectorSize)
-#define MaxFileSize2	(NumDirect * NumDirect * SectorSize)
-#define MaxFileSize3	(NumDirect * NumDirect * NumDirect * SectorSize)
-#define MaxFileSize4	(NumDirect * NumDirect * NumDirect * NumDirect * SectorSize)
+// An extent is a run of sectors of a file that are stored in consecutive
+// sectors on disk: "length" sectors of the file, starting at sector
+// "fileSector" of the file, are in the disk sectors starting at "start".
+//
+// A file that doesn't fit in the extents of its header gets a tree of
+// "extent blocks".  Each entry in an interior node of the tree describes
+// a subtree instead of data: the "length" sectors of the file starting at
+// "fileSector" are described by the extents in the extent block whose
+// disk sector is "start".
+
+class Extent {
+  public:
+    int fileSector;			// first sector of the file covered
+    int start;				// first disk sector of the run, or
+					// the extent block for the subtree
+    int length;				// # of file sectors covered
+};
+
+#define NumHeaderExtents ((SectorSize - 3 * sizeof(int)) / sizeof(Extent))
+#define NumBlockExtents	 ((SectorSize - sizeof(int)) / sizeof(Extent))
+
+// A small file keeps its data in its header sector, in place of the
+// extents, so that it takes one sector instead of two, and reading it
+// takes one disk read.  Its header has "depth" set to InlineDepth.
+
+#define MaxInlineBytes	 ((int) (SectorSize - 2 * sizeof(int)))
+const int InlineDepth = -1;
+
+// The contents of an extent block, as stored in one disk sector.
+
+class ExtentBlock {
+  public:
+    int numExtents;			// # of entries in use
+    Extent extents[NumBlockExtents];	// sorted by fileSector
+};
 
 // The following class defines the Nachos "file header" (in UNIX terms,  
 // the "i-node"), describing where on disk to find all of the data in the file.
-// The file header is organized as a simple table of pointers to
-// data blocks. 
+// The file header is organized as a table of extents; a file with more
+// extents than fit in the header has a tree of extent blocks, "depth"
+// levels deep, under it.  Since data is allocated in runs that are as
+// long as possible, most files need only a few extents.  The parts of
+// a file not covered by any extent are holes, which read as zeros.
+// A file of no more than MaxInlineBytes has no extents at all; its
+// data is in the header.
 //
 // The file header data structure can be stored in memory or on disk.
-// When it is on disk, it is stored in a single sector -- this means
-// that we assume the size of this data structure to be the same
-// as one disk sector.  Without indirect addressing, this
-// limits the maximum file length to just under 4K bytes.
+// When it is on disk, it is stored in a single sector.
 //
 // There is no constructor; rather the file header can be initialized
 // by allocating blocks for the file (if it is a new file), or by
@@ -55,6 +79,15 @@ class FileHeader {
     bool Allocate(PersistentBitmap *bitMap, int fileSize);// Initialize a file header, 
 						//  including allocating space 
 						//  on disk for the file data
+    void AllocateSparse(int fileSize);	// Initialize a file header for a
+					//  new file that is all one hole
+    bool Extend(PersistentBitmap *bitMap, int newSize);
+    					// Make the file longer, allocating
+					//  space on disk for the new data
+    bool Fill(PersistentBitmap *bitMap, int position, int length);
+					// Allocate space on disk for the
+					//  part of the file about to be
+					//  written, if it is in a hole
     void Deallocate(PersistentBitmap *bitMap);  // De-allocate this file's 
 						//  data blocks
 
@@ -64,18 +97,19 @@ class FileHeader {
 
     int ByteToSector(int offset);	// Convert a byte offset into the file
 					// to the disk sector containing
-					// the byte
+					// the byte, or -1 for a hole
+    int SectorsInRun(int offset);	// # of sectors from the one holding
+					// the byte on, that are consecutive
+					// on disk (or in the same hole)
+
+    char *InlineData();			// The file's data, if it is kept in
+					// the header, or else NULL
 
     int FileLength();			// Return the length of the file 
 					// in bytes
 
     void Print();			// Print the contents of the file.
 
-	///
-	void PerMutiPrint();
-	int PerByteToSectorCalc(int offset, int maxFileSize);
-	void MultiLayerAlloc(PersistentBitmap *freeMap, int fileSize, int maxFileSize);
-	///
   private:
 	
 	/*
@@ -87,15 +121,56 @@ class FileHeader {
 		In order to implement a data structure, you will need to add some "in-core" data
 		to maintain data structure.
 		
-		Disk Part - numBytes, numSectors, dataSectors occupy exactly 128 bytes and will be
-		written to a sector on disk.
-		In-core part - none
+		Disk Part - numBytes, depth, numExtents, extents (120 bytes,
+		padded to a sector when written); or, for a small file,
+		numBytes, depth and inlineData (a full sector).
+		In-core part - leaves, numLeaves, lastLeaf
 		
 	*/
     int numBytes;			// Number of bytes in the file
-    int numSectors;			// Number of data sectors in the file
-    int dataSectors[NumDirect];		// Disk sector numbers for each data 
-					// block in the file
+    int depth;				// # of levels of extent blocks
+					// below the header; 0 if "extents"
+					// describe the data itself, or
+					// InlineDepth if there are none
+    int numExtents;			// # of entries of "extents" in use
+    Extent extents[NumHeaderExtents];	// where the file's data is,
+					// sorted by fileSector
+    char inlineData[MaxInlineBytes];	// the data itself, for a small file
+
+    Extent *leaves;			// in-core copy of the extents at the
+					// bottom of the tree, if depth > 0;
+					// NULL until first needed
+    int numLeaves;			// # of entries in "leaves"
+    int lastLeaf;			// the extent ByteToSector last used,
+					// tried first on the next call
+
+    void LoadLeaves();			// Read the extent blocks into "leaves"
+    static int FindExtent(Extent *table, int count, int fileSector);
+					// Which entry of "table" covers
+					// "fileSector"
+    static Extent *NewExtent(Extent **table, int *count, int *size);
+					// Add an entry to a table of extents
+    void AllocateRuns(PersistentBitmap *freeMap, Extent **table,
+			int *count, int *size, int fromSector, int toSector,
+			int room);	// Allocate data blocks for a range
+					// of file sectors
+    bool BuildTree(PersistentBitmap *freeMap, Extent *table, int count);
+					// Make the header (and extent blocks,
+					// if need be) describe "table"
+    static int BlocksNeeded(int count);	// # of extent blocks for a table
+					// of "count" extents
+    static void FreeTree(PersistentBitmap *freeMap, Extent *table,
+				int count, int level);
+					// Free the sectors of a subtree
+    static void FreeBlocks(PersistentBitmap *freeMap, Extent *table,
+				int count, int level);
+					// Free the extent blocks of a subtree
+    static void PrintTree(Extent *table, int count, int level);
+					// Print the extents of a subtree
+    static void CollectTree(Extent *table, int count, int level,
+				Extent *leaves, int *numLeaves);
+					// Append the data extents of a
+					// subtree to "leaves"
 };
 
 #endif // FILEHDR_H
@@ -21,20 +21,22 @@
 //	The file system assumes that the bitmap and directory files are
 //	kept "open" continuously while Nachos is running.
 //
+//	The bitmap is also kept in memory, once it has been read in, so
+//	that each operation does not have to read all of it off disk.
+//
 //	For those operations (such as Create, Remove) that modify the
 //	directory and/or bitmap, if the operation succeeds, the changes
 //	are written immediately back to disk (the two files are kept
-//	open during all this time).  If the operation fails, and we have
+//	open during all this time); only the sectors of the bitmap that
+//	changed need to be written.  If the operation fails, and we have
 //	modified part of the directory and/or bitmap, we simply discard
-//	the changed version, without writing it back to disk.
+//	the changed version, without writing it back to disk (for the
+//	bitmap, by reading the changed sectors back in).
 //
 // 	Our implementation at this point has the following restrictions:
 //
 //	   there is no synchronization for concurrent accesses
-//	   files have a fixed size, set when the file is created
 //	   files cannot be bigger than about 3KB in size
-//	   there is no hierarchical directory structure, and only a limited
-//	     number of files can be added to the system
 //	   there is no attempt to make the system robust to failures
 //	    (if Nachos exits in the middle of an operation that modifies
 //	    the file system, it may corrupt the disk)
@@ -73,8 +75,16 @@
 FileSystem::FileSystem(bool format)
 { 
     DEBUG(dbgFile, "Initializing the file system.");
+    nameCache = new NameCacheEntry[NameCacheSize];
+    for (int i = 0; i < NameCacheSize; i++) {
+	nameCache[i].dirSector = -1;
+    }
+    openFileTable = new OpenFileEntry[MaxOpenFiles];
+    for (int i = 0; i < MaxOpenFiles; i++) {
+	openFileTable[i].hdr = NULL;
+    }
     if (format) {
-        PersistentBitmap *freeMap = new PersistentBitmap(NumSectors);
+        freeMap = new PersistentBitmap(NumSectors);
         Directory *directory = new Directory(NumDirEntries);
 		FileHeader *mapHdr = new FileHeader;
 		FileHeader *dirHdr = new FileHeader;
@@ -122,8 +132,6 @@ FileSystem::FileSystem(bool format)
 			freeMap->Print();
 			directory->Print();
         }
-        currentOpenFile = NULL;
-        delete freeMap; 
 		delete directory; 
 		delete mapHdr; 
 		delete dirHdr;
@@ -132,6 +140,7 @@ FileSystem::FileSystem(bool format)
 		// the bitmap and directory; these are left open while Nachos is running
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(DirectorySector);
+        freeMap = NULL;
     }
 }
 
@@ -141,20 +150,195 @@ FileSystem::FileSystem(bool format)
 //----------------------------------------------------------------------
 FileSystem::~FileSystem()
 {
+	delete freeMap;
 	delete freeMapFile;
 	delete directoryFile;
+	delete [] nameCache;
+	for (int i = 0; i < MaxOpenFiles; i++) {
+		delete openFileTable[i].hdr;
+	}
+	delete [] openFileTable;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LoadFreeMap
+// 	Read the bitmap of free sectors into memory, if this is the first
+//	time it is needed.
+//----------------------------------------------------------------------
+
+void
+FileSystem::LoadFreeMap()
+{
+    if (freeMap == NULL)
+        freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::OpenDirectory
+// 	Open the directory file whose header is at "sector".  The root
+//	directory is kept open, and its open file is returned rather than
+//	a new one, so that there is only one in-core copy of its header
+//	to change when the directory grows.
+//
+//	"sector" -- where the directory's file header is
+//----------------------------------------------------------------------
+
+OpenFile *
+FileSystem::OpenDirectory(int sector)
+{
+    if (sector == DirectorySector)
+	return directoryFile;
+    return new OpenFile(sector);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::GrowDirectory
+// 	Make a directory file as long as the directory now needs -- its
+//	table grows as files are added -- allocating more space for it,
+//	and writing back its file header.  Return FALSE if there is not
+//	enough free space; the caller reverts the bitmap.
+//
+//	"directory" -- the directory, as changed
+//	"file" -- the open directory file
+//	"sector" -- where the directory's file header is
+//----------------------------------------------------------------------
+
+bool
+FileSystem::GrowDirectory(Directory *directory, OpenFile *file, int sector)
+{
+    FileHeader *hdr = file->getHdr();
+
+    if (file->Length() >= directory->FileLength())
+	return TRUE;
+    LoadFreeMap();
+    if (!hdr->Extend(freeMap, directory->FileLength()))
+	return FALSE;
+    hdr->WriteBack(sector);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FetchDirectory
+// 	Read in the directory whose header is at "sector", as the one a
+//	path lookup is looking in, unless it is the one already read in.
+//	The directory file is closed when the TraverseFile is deleted.
+//
+//	"traverseFile" -- the lookup
+//	"sector" -- where the directory's file header is
+//----------------------------------------------------------------------
+
+void
+FileSystem::FetchDirectory(TraverseFile *traverseFile, int sector)
+{
+    if (traverseFile->dirSector == sector)
+	return;
+    if (traverseFile->closeFile)
+	delete traverseFile->openFile;
+    traverseFile->openFile = OpenDirectory(sector);
+    traverseFile->closeFile = (sector != DirectorySector);
+    traverseFile->dirSector = sector;
+    traverseFile->directory->FetchFrom(traverseFile->openFile);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::NameSlot
+// 	Return the entry of the name cache that a name in a directory
+//	goes in: a hash (FNV-1a) of the name and the directory's sector.
+//
+//	"dirSector" -- the directory's header sector
+//	"name" -- the name in it
+//----------------------------------------------------------------------
+
+int
+FileSystem::NameSlot(int dirSector, char *name)
+{
+    unsigned hash = 2166136261u;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++) {
+	hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    }
+    hash = (hash ^ dirSector) * 16777619u;
+    return hash & (NameCacheSize - 1);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LookupName
+// 	Look up a name in a directory in the name cache.  Return TRUE,
+//	with the name's header sector (-1 if there is no such name) and
+//	whether it is a directory, if the cache has the answer; FALSE if
+//	the directory itself has to be searched.
+//
+//	"dirSector" -- the directory's header sector
+//	"name" -- the name to look up
+//	"sector", "isDir" -- where to return what was found
+//----------------------------------------------------------------------
+
+bool
+FileSystem::LookupName(int dirSector, char *name, int *sector, bool *isDir)
+{
+    NameCacheEntry *entry = &nameCache[NameSlot(dirSector, name)];
+
+    if (entry->dirSector != dirSector
+		|| strncmp(entry->name, name, FileNameMaxLen))
+	return FALSE;
+    *sector = entry->sector;
+    *isDir = entry->isDir;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::EnterName
+// 	Remember what a name in a directory refers to, replacing what the
+//	cache held for it, or for another name that hashes to the same
+//	entry.
+//
+//	"dirSector" -- the directory's header sector
+//	"name" -- the name in it
+//	"sector" -- the name's header sector, or -1 if there is no such
+//		name in the directory
+//	"isDir" -- is it a directory?
+//----------------------------------------------------------------------
+
+void
+FileSystem::EnterName(int dirSector, char *name, int sector, bool isDir)
+{
+    NameCacheEntry *entry = &nameCache[NameSlot(dirSector, name)];
+
+    entry->dirSector = dirSector;
+    strncpy(entry->name, name, FileNameMaxLen);
+    entry->name[FileNameMaxLen] = '\0';
+    entry->sector = sector;
+    entry->isDir = isDir;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ForgetDirectory
+// 	Drop every entry for a name in a directory that is being removed,
+//	since its header sector may be reused for a new directory.
+//
+//	"dirSector" -- the directory's header sector
+//----------------------------------------------------------------------
+
+void
+FileSystem::ForgetDirectory(int dirSector)
+{
+    for (int i = 0; i < NameCacheSize; i++) {
+	if (nameCache[i].dirSector == dirSector)
+	    nameCache[i].dirSector = -1;
+    }
 }
 
 //----------------------------------------------------------------------
 // FileSystem::Create
 // 	Create a file in the Nachos file system (similar to UNIX create).
-//	Since we can't increase the size of files dynamically, we have
-//	to give Create the initial size of the file.
+//	The new file is all one hole, "initialSize" bytes long: no
+//	space is allocated for its data until it is written (see
+//	OpenFile::WriteAt), and files grow when they are written past
+//	the end.
 //
 //	The steps to create a file are:
 //	  Make sure the file doesn't already exist
 //        Allocate a sector for the file header
-// 	  Allocate space on disk for the data blocks for the file
 //	  Add the name to the directory
 //	  Store the new file header on disk 
 //	  Flush the changes to the bitmap and the directory back to disk
@@ -165,7 +349,6 @@ FileSystem::~FileSystem()
 //   		file is already in directory
 //	 	no free space for file header
 //	 	no free entry for file in directory
-//	 	no free space for data blocks for the file 
 //
 // 	Note that this implementation assumes there is no concurrent access
 //	to the file system!
@@ -176,37 +359,43 @@ FileSystem::~FileSystem()
 
 TraverseFile* FileSystem::GetTraverseFileByName(char *name) {
     TraverseFile *traverseFile = new TraverseFile();
-    Directory *directory = new Directory(NumDirEntries);
-    OpenFile *tempOpenFile = directoryFile; // Start from root
-    int foundSector = DirectorySector; // Start from root
+    int dirSector = DirectorySector; // the directory the next name is in, starting from root
+    int foundSector = DirectorySector;
     int belongSector = DirectorySector;
-    int memoryForLastBelongSector; // When we traverse the directory, not file, the var "belongSector" will get wrong, the true belongSector is the above layer of belongSector
+    int memoryForLastBelongSector = DirectorySector; // When we traverse the directory, not file, the var "belongSector" will get wrong, the true belongSector is the above layer of belongSector
+    bool isDir;
     char *finalName = "";
+    char *path = new char[strlen(name) + 1];
 
-    directory->FetchFrom(tempOpenFile);
-
-    char *pch = strtok(name, "/"); // Because path is seperated by '/'
+    strcpy(path, name); // strtok changes the string it is given
+    char *pch = strtok(path, "/"); // Because path is seperated by '/'
     while(pch != NULL) {
-        // Try to find the directory is existed or not
+        // Try to find the directory is existed or not, in the name cache
+        // first, and then in the directory itself
         finalName = pch;
-        foundSector = directory->Find(pch);
-        if (foundSector < 0 || !directory->checkIfDir(pch)) {
+        if (!LookupName(dirSector, pch, &foundSector, &isDir)) {
+            FetchDirectory(traverseFile, dirSector);
+            foundSector = traverseFile->directory->Find(pch);
+            isDir = foundSector >= 0 && traverseFile->directory->checkIfDir(pch);
+            EnterName(dirSector, pch, foundSector, isDir);
+        }
+        if (foundSector < 0 || !isDir) {
             // Means not exists, we need to break while loop, and construct the subDirectory / file
             break;
         }
         // Link to next directory
-        tempOpenFile = new OpenFile(foundSector);
-        directory->FetchFrom(tempOpenFile);
         memoryForLastBelongSector = belongSector;
-        belongSector = foundSector;
+        belongSector = dirSector = foundSector;
         pch = strtok(NULL, "/");
     }
-    traverseFile->directory = directory;
-    strcpy(traverseFile->finalName, finalName);
+    FetchDirectory(traverseFile, dirSector);
+    strncpy(traverseFile->finalName, finalName, FileNameMaxLen);
+    traverseFile->finalName[FileNameMaxLen] = '\0';
     traverseFile->finalSector = foundSector;
     traverseFile->isDir = (belongSector == foundSector);
     // When traversed inode is dir, we need to find above them.
     traverseFile->belongSector = traverseFile->isDir ? memoryForLastBelongSector : belongSector;
+    delete [] path;
 
     DEBUG('f', "traverse name: " << traverseFile->finalName);
     DEBUG('f', "traverse sector: " << traverseFile->finalSector);
@@ -220,7 +409,6 @@ FileSystem::Create(char *name, int initialSize)
 {
     TraverseFile *traverseFile;
     Directory *directory;
-    PersistentBitmap *freeMap;
     FileHeader *hdr;
     int sector;
     char *finalName;
@@ -230,12 +418,12 @@ FileSystem::Create(char *name, int initialSize)
     traverseFile = GetTraverseFileByName(name);
     directory = traverseFile->directory;
     finalName = traverseFile->finalName;
-    OpenFile *belongDirOpenFile = new OpenFile(traverseFile->belongSector);
+    OpenFile *belongDirOpenFile = traverseFile->openFile;
 
-    if (directory->Find(finalName) != -1) {
+    if (traverseFile->isDir || directory->Find(finalName) != -1) {
         success = FALSE;			// file is already in directory
     } else {	
-        freeMap = new PersistentBitmap(freeMapFile,NumSectors);
+        LoadFreeMap();
         sector = freeMap->FindAndSet();	// find a sector to hold the file header
     	if (sector == -1) {	
             success = FALSE;		// no free block for file header 
@@ -245,21 +433,25 @@ FileSystem::Create(char *name, int initialSize)
         }
 	    else {
             hdr = new FileHeader;
-            if (!hdr->Allocate(freeMap, initialSize)) {
-                success = FALSE;	// no space on disk for data
+            hdr->AllocateSparse(initialSize);
+            if (!GrowDirectory(directory, belongDirOpenFile,
+					traverseFile->belongSector)) {
+                success = FALSE;	// no space on disk for directory
             } else {	
                 success = TRUE;
                 // everthing worked, flush all changes back to disk
                 hdr->WriteBack(sector); 		
                 directory->WriteBack(belongDirOpenFile);
                 freeMap->WriteBack(freeMapFile);
+                EnterName(traverseFile->belongSector, finalName, sector, FALSE);
             }
             delete hdr;
 	    }
-        delete freeMap;
+        if (!success)
+            freeMap->Revert(freeMapFile);	// undo any allocation
     }
 
-    delete directory;
+    delete traverseFile;
     return success;
 }
 
@@ -268,7 +460,12 @@ FileSystem::Create(char *name, int initialSize)
 // 	Open a file for reading and writing.  
 //	To open a file:
 //	  Find the location of the file's header, using the directory 
-//	  Bring the header into memory
+//	  Bring the header into memory, unless the file is already open
+//
+//	All the opens of a file share one in-core header, so that a file
+//	grown through one of them is seen at its new length through the
+//	others.  (If too many files are open, the file gets a header of
+//	its own.)
 //
 //	"name" -- the text name of the file to be opened
 //----------------------------------------------------------------------
@@ -277,31 +474,148 @@ OpenFile *
 FileSystem::Open(char *name)
 { 
     TraverseFile *traverseFile;
-    Directory *directory = new Directory(NumDirEntries);
     OpenFile *openFile = NULL;
+    FileHeader *hdr;
     int sector;
 
     traverseFile = GetTraverseFileByName(name);
-    openFile = new OpenFile(traverseFile->finalSector);
-
+    sector = traverseFile->finalSector;
+    delete traverseFile;
+
+    if (sector >= 0) {
+	hdr = GetHeader(sector);
+	if (hdr != NULL)
+	    openFile = new OpenFile(sector, hdr);
+	else
+	    openFile = new OpenFile(sector);
+    }
     return openFile;
 }
 
-OpenFileId FileSystem::OpenAFile(char *name) {
-    currentOpenFile = Open(name);
-    return 1; // Becasue nachos only allow to accept one file open.
+//----------------------------------------------------------------------
+// FileSystem::OpenAFile/CloseAFile
+// 	Open or close a file for a user program.
+//
+//	"name" -- the text name of the file to be opened
+//	"openFile" -- the file to close
+//----------------------------------------------------------------------
+
+OpenFile *
+FileSystem::OpenAFile(char *name)
+{
+    return Open(name);
 }
 
-int FileSystem::CloseAFile() {
-    currentOpenFile = NULL;
+int
+FileSystem::CloseAFile(OpenFile *openFile)
+{
+    delete openFile;
     return 1;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::GetHeader
+// 	Return the in-core header of a file being opened: the one in the
+//	open file table, if the file is already open, or else a new one,
+//	read from disk.  Return NULL if the table is full.
+//
+//	"sector" -- where the header is on disk
+//----------------------------------------------------------------------
+
+FileHeader *
+FileSystem::GetHeader(int sector)
+{
+    int free = -1;
+
+    for (int i = 0; i < MaxOpenFiles; i++) {
+	if (openFileTable[i].hdr == NULL) {
+	    if (free == -1)
+		free = i;
+	} else if (openFileTable[i].sector == sector) {
+	    openFileTable[i].refCount++;
+	    return openFileTable[i].hdr;
+	}
+    }
+    if (free == -1)
+	return NULL;			// too many files open
+    openFileTable[free].sector = sector;
+    openFileTable[free].hdr = new FileHeader;
+    openFileTable[free].hdr->FetchFrom(sector);
+    openFileTable[free].refCount = 1;
+    return openFileTable[free].hdr;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReleaseHeader
+// 	Note that a file is being closed, and let go of its in-core header,
+//	if no one else has the file open.
+//
+//	"hdr" -- the header, as returned by GetHeader
+//----------------------------------------------------------------------
+
+void
+FileSystem::ReleaseHeader(FileHeader *hdr)
+{
+    for (int i = 0; i < MaxOpenFiles; i++) {
+	if (openFileTable[i].hdr == hdr) {
+	    if (--openFileTable[i].refCount == 0) {
+		delete hdr;
+		openFileTable[i].hdr = NULL;
+	    }
+	    return;
+	}
+    }
+    ASSERTNOTREACHED();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::IsOpen
+// 	Return TRUE if the file whose header is at "sector" is open, so
+//	that its header is in the open file table.
+//
+//	"sector" -- where the header is on disk
+//----------------------------------------------------------------------
+
+bool
+FileSystem::IsOpen(int sector)
+{
+    for (int i = 0; i < MaxOpenFiles; i++) {
+	if (openFileTable[i].hdr != NULL && openFileTable[i].sector == sector)
+	    return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FillFile
+// 	Get a file ready to be written: allocate space for the part of it
+//	being written that is in holes, make the file longer if the write
+//	goes past the end, and write the file header and the bitmap back
+//	to disk.  Return FALSE if the disk is full, leaving the file as it
+//	was.
+//
+//	"hdr" -- the file's header, in memory
+//	"sector" -- where the header is on disk
+//	"position", "length" -- the bytes of the file being written
+//----------------------------------------------------------------------
+
+bool
+FileSystem::FillFile(FileHeader *hdr, int sector, int position, int length)
+{
+    LoadFreeMap();
+    if (!hdr->Fill(freeMap, position, length)) {
+	freeMap->Revert(freeMapFile);	// undo any allocation
+	return FALSE;
+    }
+    hdr->WriteBack(sector);
+    freeMap->WriteBack(freeMapFile);
+    return TRUE;
+}
+
 bool FileSystem::CreateDirectory(char *name) {
     TraverseFile *traverseFile;
     Directory *directory;
-    PersistentBitmap *freeMap;
-    FileHeader *dirHdr = new FileHeader;
+    FileHeader *dirHdr;
     int newSector;
     bool success = true;
     char *pch;
@@ -310,36 +624,53 @@ bool FileSystem::CreateDirectory(char *name) {
     traverseFile = GetTraverseFileByName(name);
     directory = traverseFile->directory;
     pch = traverseFile->finalName;
-    OpenFile *belongDirOpenFile = new OpenFile(traverseFile->belongSector);
+    OpenFile *belongDirOpenFile = traverseFile->openFile;
+
+    // If the path names a directory, the lookup has read in that
+    // directory, not the one it is in, so nothing may be changed
+    if (traverseFile->isDir || directory->Find(pch) != -1) {
+        delete traverseFile;
+        return FALSE;			// already exists
+    }
 
     // Out from while loop, which means we're going to construct subDirectory
     // 1. Find free sector
-    freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+    LoadFreeMap();
     newSector = freeMap->FindAndSet();	// find a sector to hold the file header
-    if (newSector == -1) success = FALSE;
-
-    // 2. link subDirectory to original directory
-    if (!directory->Add(pch, newSector, true)) success = FALSE;
-
-    // 3. Build up subDirectory <File Header>
-    dirHdr->Allocate(freeMap, DirectoryFileSize);
-    dirHdr->WriteBack(newSector);
-
-    // 4. Build up subDirectory <Directory>
-    Directory *subDirectory = new Directory(NumDirEntries);
-    OpenFile* newDirectoryFile = new OpenFile(newSector);
-    subDirectory->WriteBack(newDirectoryFile);
+    if (newSector == -1) {
+        delete traverseFile;
+        return FALSE;			// no free block for file header
+    }
 
-    // 5. Update directory / freeMap on disk
-    directory->WriteBack(belongDirOpenFile);
-    freeMap->WriteBack(freeMapFile);
+    // 2. Build up subDirectory <File Header>, then link subDirectory to
+    // original directory (growing the directory writes its header back,
+    // so it goes last)
+    dirHdr = new FileHeader;
+    if (!dirHdr->Allocate(freeMap, DirectoryFileSize)) success = FALSE;
+    else if (!directory->Add(pch, newSector, true)) success = FALSE;
+    else if (!GrowDirectory(directory, belongDirOpenFile,
+			traverseFile->belongSector)) success = FALSE;
+
+    if (success) {
+        // 3. Build up subDirectory <Directory>
+        dirHdr->WriteBack(newSector);
+        Directory *subDirectory = new Directory(NumDirEntries);
+        OpenFile* newDirectoryFile = new OpenFile(newSector);
+        subDirectory->WriteBack(newDirectoryFile);
+        delete subDirectory;
+        delete newDirectoryFile;
+
+        // 4. Update directory / freeMap on disk
+        directory->WriteBack(belongDirOpenFile);
+        freeMap->WriteBack(freeMapFile);
+        EnterName(traverseFile->belongSector, pch, newSector, TRUE);
+    } else {
+        freeMap->Revert(freeMapFile);	// undo any allocation
+    }
 
-    // 6. Free local storage
-    delete directory;
-    delete subDirectory;
-    delete freeMap;
+    // 5. Free local storage
+    delete traverseFile;
     delete dirHdr;
-    delete newDirectoryFile;
 
     return success;
 }
@@ -353,9 +684,16 @@ bool FileSystem::CreateDirectory(char *name) {
 //	    Write changes to directory, bitmap back to disk
 //
 //	Return TRUE if the file was deleted, FALSE if the file wasn't
-//	in the file system.
+//	in the file system, or is open.  (An open file's in-core header
+//	stays in the open file table, keyed by its sector; if the file
+//	were removed, a new file given the same sector would be opened
+//	with the old header.)  A directory is only removed once it is
+//	empty: if it isn't, and isn't being removed along with what is in
+//	it, or anything in it couldn't be removed, it is kept, so that
+//	what is in it can still be reached.
 //
 //	"name" -- the text name of the file to be removed
+//	"shouldRecursive" -- remove what is in a directory, too
 //----------------------------------------------------------------------
 
 bool
@@ -363,7 +701,6 @@ FileSystem::Remove(char *name, bool shouldRecursive)
 { 
     TraverseFile *traverseFile;
     Directory *directory;
-    PersistentBitmap *freeMap;
     FileHeader *fileHdr;
     int sector;
     char *finalName;
@@ -373,46 +710,62 @@ FileSystem::Remove(char *name, bool shouldRecursive)
     directory = traverseFile->directory;
 
     // Check whether should recursive search
-    if (shouldRecursive && traverseFile->isDir) {
+    if (traverseFile->isDir) {
         DirectoryEntry *table = directory->GetTable();
+        bool removedAll = TRUE;
         strcpy(pwd, name);
         for (int i=0; i<directory->GetTableSize(); i++) {
-            if (table[i].inUse) {
+            if (!table[i].inUse) {
+                continue;
+            } else if (!shouldRecursive) {
+                removedAll = FALSE;		// not empty
+            } else {
                 sprintf(buffer, "%s/%s", pwd, table[i].name);
-                Remove(buffer, true);
+                if (!Remove(buffer, true))
+                    removedAll = FALSE;		// open, say
             }
         }
+        if (!removedAll) {
+            delete traverseFile;
+            return FALSE;		// keep the directory, and what's left
+        }
         // Redirect directory to directory above current.
         // Why?
         // e.g. We're deleting "/abc"
         // current directory is point to "/abc"
         // But what we need is "/" 
-        OpenFile *tempOpenFile = new OpenFile(traverseFile->belongSector);
-        directory->FetchFrom(tempOpenFile);
+        FetchDirectory(traverseFile, traverseFile->belongSector);
     }
     
     sector = traverseFile->finalSector;
     finalName = traverseFile->finalName;
-    OpenFile *belongDirOpenFile = new OpenFile(traverseFile->belongSector);
+    OpenFile *belongDirOpenFile = traverseFile->openFile;
 
-    if (sector == -1) {
-       delete directory;
+    if (sector == -1 || sector == DirectorySector) {
+       delete traverseFile;
        return FALSE;			 // file not found 
     }
+    if (IsOpen(sector)) {
+	DEBUG(dbgFile, "Not removing " << name << ", it is open.");
+	delete traverseFile;
+	return FALSE;
+    }
     fileHdr = new FileHeader;
     fileHdr->FetchFrom(sector);
 
-    freeMap = new PersistentBitmap(freeMapFile,NumSectors);
+    LoadFreeMap();
 
     fileHdr->Deallocate(freeMap);  		// remove data blocks
     freeMap->Clear(sector);			// remove header block
     directory->Remove(finalName);
+    EnterName(traverseFile->belongSector, finalName, -1, FALSE);
+    if (traverseFile->isDir)
+        ForgetDirectory(sector);
 
     freeMap->WriteBack(freeMapFile);		// flush to disk
     directory->WriteBack(belongDirOpenFile);        // flush to disk
     delete fileHdr;
-    delete directory;
-    delete freeMap;
+    delete traverseFile;
     return TRUE;
 } 
 
@@ -423,14 +776,14 @@ FileSystem::Remove(char *name, bool shouldRecursive)
 
 void FileSystem::List(char *name, bool shouldRecursive) {
     TraverseFile *traverseFile;
-    Directory *directory = new Directory(NumDirEntries);
+    Directory *directory;
     traverseFile = GetTraverseFileByName(name);
     directory = traverseFile->directory;
 
     if (shouldRecursive) directory->RecursiveList();
     else directory->List();
 
-    delete directory;
+    delete traverseFile;
 }
 
 //----------------------------------------------------------------------
@@ -448,9 +801,10 @@ FileSystem::Print()
 {
     FileHeader *bitHdr = new FileHeader;
     FileHeader *dirHdr = new FileHeader;
-    PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile,NumSectors);
     Directory *directory = new Directory(NumDirEntries);
 
+    LoadFreeMap();
+
     printf("Bit map file header:\n");
     bitHdr->FetchFrom(FreeMapSector);
     bitHdr->Print();
@@ -466,7 +820,6 @@ FileSystem::Print()
 
     delete bitHdr;
     delete dirHdr;
-    delete freeMap;
     delete directory;
 }
 
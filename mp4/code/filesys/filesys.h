@@ -38,12 +38,10 @@
 #include "openfile.h"
 #include "directory.h"
 
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number 
-// of files that can be loaded onto the disk.
+// Initial file sizes for the bitmap and directory; a directory file
+// grows as files are added to it (see Directory).
 #define FreeMapFileSize 	(NumSectors / BitsInByte)
-#define NumDirEntries 		10
-#define DirectoryFileSize 	(sizeof(DirectoryEntry) * NumDirEntries)
+#define DirectoryFileSize 	(sizeof(DirectoryEntry) * (NumDirEntries + 1))
 
 typedef int OpenFileId;
 
@@ -77,20 +75,69 @@ class FileSystem {
 
 #else // FILESYS
 
+class PersistentBitmap;
+class FileHeader;
+
+// The file system keeps one in-core copy of the header of each open file,
+// shared by all the opens of the file (in UNIX terms, the in-core inode
+// table), so that a file grown through one open is seen at its new
+// length through the others.  Each open has its own OpenFile, with its
+// own seek position; a process's OpenFileIds index its table of them
+// (see AddrSpace).
+
+const int MaxOpenFiles = 64;		// most files open at once, by all
+					// programs together
+
+class OpenFileEntry {
+  public:
+    int sector;				// where the header is on disk
+    FileHeader *hdr;			// the in-core header, or NULL if the
+					// entry is not in use
+    int refCount;			// # of OpenFiles sharing it
+};
+
+// The file system remembers the results of recent name lookups, so that
+// following a path doesn't read every directory along it.  The cache is
+// direct mapped: a <directory, name> pair has just one entry it can go
+// in, picked by hashing, and replaces whatever was there.  Lookups that
+// fail are remembered too ("negative" entries), since Create looks up
+// names it expects not to find.  Create, CreateDirectory and Remove keep
+// the entries for the names they change up to date.
+
+const int NameCacheSize = 256;		// # of entries; a power of 2
+
+class NameCacheEntry {
+  public:
+    int dirSector;			// header sector of the directory
+					// searched, or -1 if not in use
+    char name[FileNameMaxLen + 1];	// the name looked up
+    int sector;				// its header sector, or -1 if the
+					// directory has no such name
+    bool isDir;				// is it a directory?
+};
+
 class TraverseFile {
 	public:
 		TraverseFile() {
 			directory = new Directory(NumDirEntries);
+			openFile = NULL;
+			dirSector = -1;
+			closeFile = FALSE;
 		}
 		~TraverseFile() {
 			delete directory;
+			if (closeFile)
+				delete openFile;
 		}
 
 		Directory *directory;
+		OpenFile *openFile; // the file "directory" was fetched from
+		int dirSector; // and its header sector, or -1 if not fetched yet
+		bool closeFile; // is "openFile" ours to close? (not if it is the root's)
 		int finalSector; // the file/subdirectory sector
 		int belongSector; // directory sector that the file/subDirectory belongs to
 		bool isDir;
-		char finalName[15];
+		char finalName[FileNameMaxLen + 1];
 };
 
 class FileSystem {
@@ -110,10 +157,16 @@ class FileSystem {
     OpenFile* Open(char *name); 	// Open a file (UNIX open)
 
 	///
-	OpenFileId OpenAFile(char *name);
-	int CloseAFile();
+	OpenFile* OpenAFile(char *name);	// Open a file for a user program
+	int CloseAFile(OpenFile *openFile);	// Close it
 	///
 
+    void ReleaseHeader(FileHeader *hdr);	// An open file that shared
+					// "hdr" is being closed
+    bool FillFile(FileHeader *hdr, int sector, int position, int length);
+					// Allocate space for a write to a
+					// file, making it longer if need be
+
     bool Remove(char *name, bool shouldRecursive);  		// Delete a file (UNIX unlink)
 
     void List(char *name, bool shouldRecursive);			// List all the files in the file system
@@ -121,15 +174,41 @@ class FileSystem {
     void Print();			// List all the files and their contents
 
 	///
-	OpenFile* currentOpenFile;
 	bool CreateDirectory(char *name);
 	TraverseFile* GetTraverseFileByName(char *name);
 	///
   private:
    OpenFile* freeMapFile;		// Bit map of free disk blocks,
 					// represented as a file
+   PersistentBitmap* freeMap;		// In-memory copy of the bit map,
+					// read in the first time it is
+					// needed (NULL until then)
+   void LoadFreeMap();			// Read in freeMap, if need be
+   OpenFile* OpenDirectory(int sector);	// Open the directory file whose
+					// header is at "sector"
+   bool GrowDirectory(Directory *directory, OpenFile *file, int sector);
+					// Make a directory file big enough
+					// for the directory
    OpenFile* directoryFile;		// "Root" directory -- list of 
 					// file names, represented as a file
+
+   OpenFileEntry *openFileTable;	// in-core headers of the open files
+   FileHeader* GetHeader(int sector);	// Share the in-core header of a
+					// file being opened
+   bool IsOpen(int sector);		// Is the file with this header open?
+
+   void FetchDirectory(TraverseFile *traverseFile, int sector);
+					// Read a directory in, for a lookup
+   NameCacheEntry *nameCache;		// recent name lookups
+   int NameSlot(int dirSector, char *name);
+					// Where a name's entry would be
+   bool LookupName(int dirSector, char *name, int *sector, bool *isDir);
+					// Find a name in the cache
+   void EnterName(int dirSector, char *name, int sector, bool isDir);
+					// Remember a name, or (if "sector"
+					// is -1) that there is no such name
+   void ForgetDirectory(int dirSector);	// Drop the entries for the names
+					// in a directory being removed
 };
 
 #endif // FILESYS
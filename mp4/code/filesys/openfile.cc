@@ -30,7 +30,33 @@ OpenFile::OpenFile(int sector)
 { 
     hdr = new FileHeader;
     hdr->FetchFrom(sector);
+    hdrSector = sector;
+    ownHdr = TRUE;
     seekPosition = 0;
+    nextSector = 0;
+    readAhead = 0;
+    readAheadEnd = 0;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::OpenFile
+// 	Open a Nachos file whose header is already in memory, shared with
+//	the other opens of the file (see FileSystem::Open).  The header is
+//	given back to the file system when the file is closed.
+//
+//	"sector" -- the location on disk of the file header for this file
+//	"sharedHdr" -- the in-core file header
+//----------------------------------------------------------------------
+
+OpenFile::OpenFile(int sector, FileHeader *sharedHdr)
+{ 
+    hdr = sharedHdr;
+    hdrSector = sector;
+    ownHdr = FALSE;
+    seekPosition = 0;
+    nextSector = 0;
+    readAhead = 0;
+    readAheadEnd = 0;
 }
 
 //----------------------------------------------------------------------
@@ -40,7 +66,10 @@ OpenFile::OpenFile(int sector)
 
 OpenFile::~OpenFile()
 {
-    delete hdr;
+    if (ownHdr)
+	delete hdr;
+    else
+	kernel->fileSystem->ReleaseHeader(hdr);
 }
 
 //----------------------------------------------------------------------
@@ -98,12 +127,22 @@ OpenFile::Write(char *into, int numBytes)
 //
 //	For ReadAt:
 //	   We read in all of the full or partial sectors that are part of the
-//	   request, but we only copy the part we are interested in.
+//	   request, but we only copy the part we are interested in.  Sectors
+//	   in a hole are not read, but filled with zeros, and a small file
+//	   is read straight out of its header.  If the
+//	   request carries on from where the last one ended, we also ask
+//	   for the sectors after it to be read ahead into the disk cache.
 //	For WriteAt:
 //	   We must first read in any sectors that will be partially written,
-//	   so that we don't overwrite the unmodified portion.  We then copy
+//	   so that we don't overwrite the unmodified portion (without
+//	   reading ahead, since they are not being read).  We then copy
 //	   in the data that will be modified, and write back all the full
-//	   or partial sectors that are part of the request.
+//	   or partial sectors that are part of the request.  Space is
+//	   allocated for the sectors that are in holes, and a write past
+//	   the end of the file makes the file longer; if it starts past the
+//	   end, the gap is left as a hole.  If the disk is full, nothing
+//	   is written.  A small file is written in its header, which is
+//	   written back to disk.
 //
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
@@ -116,29 +155,36 @@ int
 OpenFile::ReadAt(char *into, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    char *buf;
-
-    if ((numBytes <= 0) || (position >= fileLength))
-    	return 0; 				// check request
-    if ((position + numBytes) > fileLength)		
-	numBytes = fileLength - position;
-    DEBUG(dbgFile, "Reading " << numBytes << " bytes at " << position << " from file of length " << fileLength);
+    int i, firstSector, lastSector, sector, run, end, queued;
 
+    numBytes = ReadBytes(into, numBytes, position);
+    if (numBytes == 0 || hdr->InlineData() != NULL)
+	return numBytes;
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
 
-    // read in all the full and partial sectors that we need
-    buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)	{
-        kernel->synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
+    // read ahead, if the file is being read sequentially
+    if (firstSector == nextSector || firstSector == nextSector - 1) {
+	readAhead = (readAhead == 0) ? MinReadAhead
+				     : min(2 * readAhead, MaxReadAhead);
+	end = min(lastSector + readAhead + 1, divRoundUp(fileLength, SectorSize));
+	for (i = max(readAheadEnd, lastSector + 1); i < end; i += run) {
+	    sector = hdr->ByteToSector(i * SectorSize);
+	    run = min(hdr->SectorsInRun(i * SectorSize), end - i);
+	    if (sector == -1)
+		continue;		// nothing to read in a hole
+	    queued = kernel->synchDisk->Prefetch(sector, run);
+	    if (queued < run) {
+		i += queued;
+		break;			// try again next time
+	    }
+	}
+	readAheadEnd = i;
+    } else {
+	readAhead = 0;
+	readAheadEnd = 0;
     }
-
-    // copy the part we want
-    bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
-    delete [] buf;
+    nextSector = lastSector + 1;
     return numBytes;
 }
 
@@ -146,16 +192,24 @@ int
 OpenFile::WriteAt(char *from, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    bool firstAligned, lastAligned;
-    char *buf;
+    int i, firstSector, lastSector, numSectors, sector, run;
+    bool firstAligned, lastAligned, filled;
+    char *buf, *zeros;
 
-    if ((numBytes <= 0) || (position >= fileLength))
+    if (numBytes <= 0)
 	return 0;				// check request
-    if ((position + numBytes) > fileLength)
-	numBytes = fileLength - position;
     DEBUG(dbgFile, "Writing " << numBytes << " bytes at " << position << " from file of length " << fileLength);
 
+    if (hdr->InlineData() != NULL && position + numBytes <= MaxInlineBytes) {
+	// the data is in the header, and still fits there
+	bcopy(from, hdr->InlineData() + position, numBytes);
+	if (position + numBytes > fileLength)	// writes back the header
+	    kernel->fileSystem->FillFile(hdr, hdrSector, position, numBytes);
+	else
+	    hdr->WriteBack(hdrSector);
+	return numBytes;
+    }
+
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
     numSectors = 1 + lastSector - firstSector;
@@ -169,19 +223,105 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
     lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
 
 // read in first and last sector, if they are to be partially modified
+// (before any space is allocated for them, while holes still read as
+// zeros)
     if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);	
+        ReadBytes(buf, SectorSize, firstSector * SectorSize);	
     if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize], 
+        ReadBytes(&buf[(lastSector - firstSector) * SectorSize], 
 				SectorSize, lastSector * SectorSize);	
 
+// allocate space for the sectors that are in holes, and for the part
+// past the end of the file
+    filled = (position + numBytes > fileLength);
+    for (i = firstSector; i <= lastSector && !filled; i += run) {
+	filled = (hdr->ByteToSector(i * SectorSize) == -1);
+	run = hdr->SectorsInRun(i * SectorSize);
+    }
+    if (filled && !kernel->fileSystem->FillFile(hdr, hdrSector, position,
+							numBytes)) {
+	delete [] buf;
+	return 0;				// disk full
+    }
+
+// sectors allocated ahead, and now in the gap between the old end of
+// the file and the write, must read as zeros
+    if (position > fileLength) {
+	zeros = new char[MaxTransfer * SectorSize];
+	memset(zeros, 0, MaxTransfer * SectorSize);
+	for (i = divRoundUp(fileLength, SectorSize); i < firstSector; i += run) {
+	    sector = hdr->ByteToSector(i * SectorSize);
+	    run = min(min(hdr->SectorsInRun(i * SectorSize), firstSector - i),
+			MaxTransfer);
+	    if (sector != -1)
+		kernel->synchDisk->WriteSectors(sector, run, zeros);
+	}
+	delete [] zeros;
+    }
+
 // copy in the bytes we want to change 
     bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
 
-// write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)	
-        kernel->synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
+// write modified sectors back, a run of consecutive disk sectors at a time
+    for (i = firstSector; i <= lastSector; i += run) {
+	sector = hdr->ByteToSector(i * SectorSize);
+	run = min(hdr->SectorsInRun(i * SectorSize), lastSector + 1 - i);
+        kernel->synchDisk->WriteSectors(sector, run,
 					&buf[(i - firstSector) * SectorSize]);
+    }
+    delete [] buf;
+    return numBytes;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadBytes
+// 	Read a portion of a file, starting at "position", as ReadAt does,
+//	but without reading ahead or noting where the read ended.  WriteAt
+//	uses it to read the sectors it writes only part of, which says
+//	nothing about what will be read next.
+//
+//	"into" -- the buffer to contain the data to be read from disk 
+//	"numBytes" -- the number of bytes to transfer
+//	"position" -- the offset within the file of the first byte
+//----------------------------------------------------------------------
+
+int
+OpenFile::ReadBytes(char *into, int numBytes, int position)
+{
+    int fileLength = hdr->FileLength();
+    int i, firstSector, lastSector, numSectors, sector, run;
+    char *buf;
+
+    if ((numBytes <= 0) || (position >= fileLength))
+    	return 0; 				// check request
+    if ((position + numBytes) > fileLength)		
+	numBytes = fileLength - position;
+    DEBUG(dbgFile, "Reading " << numBytes << " bytes at " << position << " from file of length " << fileLength);
+
+    if (hdr->InlineData() != NULL) {		// in the header; no disk
+	bcopy(hdr->InlineData() + position, into, numBytes);	// to read
+	return numBytes;
+    }
+
+    firstSector = divRoundDown(position, SectorSize);
+    lastSector = divRoundDown(position + numBytes - 1, SectorSize);
+    numSectors = 1 + lastSector - firstSector;
+
+    // read in all the full and partial sectors that we need, a run of
+    // consecutive disk sectors at a time
+    buf = new char[numSectors * SectorSize];
+    for (i = firstSector; i <= lastSector; i += run) {
+	sector = hdr->ByteToSector(i * SectorSize);
+	run = min(hdr->SectorsInRun(i * SectorSize), lastSector + 1 - i);
+	if (sector == -1)			// a hole
+	    memset(&buf[(i - firstSector) * SectorSize], 0, run * SectorSize);
+	else
+	    kernel->synchDisk->ReadSectors(sector, run,
+					&buf[(i - firstSector) * SectorSize]);
+    }
+
+    // copy the part we want
+    bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
     delete [] buf;
     return numBytes;
 }
@@ -62,10 +62,21 @@ class OpenFile {
 #else // FILESYS
 class FileHeader;
 
+// While a file is being read sequentially, the sectors after the ones
+// asked for are read ahead into the disk cache.  The number of sectors
+// read ahead starts at MinReadAhead, and doubles with each sequential
+// read up to MaxReadAhead; any other read stops the read ahead.
+
+const int MinReadAhead = 2;
+const int MaxReadAhead = 16;
+
 class OpenFile {
   public:
     OpenFile(int sector);		// Open a file whose header is located
 					// at "sector" on the disk
+    OpenFile(int sector, FileHeader *sharedHdr);
+					// Open a file whose header is
+					// already in memory
     ~OpenFile();			// Close the file
 
     void Seek(int position); 		// Set the position from which to 
@@ -90,7 +101,16 @@ class OpenFile {
     
   private:
     FileHeader *hdr;			// Header for this file 
+    int hdrSector;			// Where "hdr" is on disk
+    bool ownHdr;			// Is "hdr" ours, or shared?
     int seekPosition;			// Current position within the file
+    int nextSector;			// sector of the file after the last
+					// one read, to spot sequential reads
+    int readAhead;			// # of sectors to read ahead
+    int readAheadEnd;			// sector of the file after the last
+					// one read ahead
+    int ReadBytes(char *into, int numBytes, int position);
+					// ReadAt, without reading ahead
 };
 
 #endif // FILESYS
@@ -2,6 +2,11 @@
 //	Routines to manage a persistent bitmap -- a bitmap that is
 //	stored on disk.
 //
+//	The bitmap is split into sector-sized pieces, and we keep track
+//	of which pieces have been modified, so that writing the bitmap
+//	back only costs as many sector writes as there were sectors
+//	changed.
+//
 // Copyright (c) 1992,1993,1995 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -16,11 +21,16 @@
 //
 //	"numItems" is the number of bits in the bitmap.
 //
-//      This constructor does not initialize the bitmap from a disk file
+//      This constructor does not initialize the bitmap from a disk file;
+//	since nothing of it is on disk yet, all of it is marked as changed.
 //----------------------------------------------------------------------
 
 PersistentBitmap::PersistentBitmap(int numItems):Bitmap(numItems) 
 { 
+    numSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    dirty = new bool[numSectors];
+    for (int i = 0; i < numSectors; i++)
+	dirty[i] = TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -37,10 +47,13 @@ PersistentBitmap::PersistentBitmap(int numItems):Bitmap(numItems)
 
 PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems):Bitmap(numItems) 
 { 
+    numSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    dirty = new bool[numSectors];
+
     // map has already been initialized by the BitMap constructor,
     // but we will just overwrite that with the contents of the
     // map found in the file
-    file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    FetchFrom(file);
 }
 
 //----------------------------------------------------------------------
@@ -50,6 +63,52 @@ PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems):Bitmap(numItems
 
 PersistentBitmap::~PersistentBitmap()
 { 
+    delete [] dirty;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Mark/Clear/FindAndSet/FindAndSetRun
+// 	Change the bitmap, as in Bitmap, remembering which sector of it
+//	the changed bit is in.
+//
+//	"which" is the number of the bit to be set or cleared.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Mark(int which)
+{
+    Bitmap::Mark(which);
+    SetDirty(which);
+}
+
+void
+PersistentBitmap::Clear(int which)
+{
+    Bitmap::Clear(which);
+    SetDirty(which);
+}
+
+int
+PersistentBitmap::FindAndSet()
+{
+    int which = Bitmap::FindAndSet();
+
+    if (which >= 0)
+	SetDirty(which);
+    return which;
+}
+
+int
+PersistentBitmap::FindAndSetRun(int wanted, int *length)
+{
+    int first = Bitmap::FindAndSetRun(wanted, length);
+
+    if (first >= 0) {
+	for (int i = first; i < first + *length; i += SectorSize * BitsInByte)
+	    SetDirty(i);
+	SetDirty(first + *length - 1);
+    }
+    return first;
 }
 
 //----------------------------------------------------------------------
@@ -63,11 +122,15 @@ void
 PersistentBitmap::FetchFrom(OpenFile *file) 
 {
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    for (int i = 0; i < numSectors; i++)
+	dirty[i] = FALSE;
+    Recount();
 }
 
 //----------------------------------------------------------------------
 // PersistentBitmap::WriteBack
-// 	Store the contents of a persistent bitmap to a Nachos file.
+// 	Store the changed parts of a persistent bitmap to a Nachos file.
+//	Runs of consecutive changed sectors are written with one WriteAt.
 //
 //	"file" is the place to write the bitmap to
 //----------------------------------------------------------------------
@@ -75,5 +138,43 @@ PersistentBitmap::FetchFrom(OpenFile *file)
 void
 PersistentBitmap::WriteBack(OpenFile *file)
 {
-   file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+    int size = numWords * sizeof(unsigned);
+    int first, last;
+
+    for (first = 0; first < numSectors; first = last) {
+	if (!dirty[first]) {
+	    last = first + 1;
+	    continue;
+	}
+	for (last = first; last < numSectors && dirty[last]; last++)
+	    dirty[last] = FALSE;
+	file->WriteAt((char *)map + first * SectorSize,
+		min(last * SectorSize, size) - first * SectorSize,
+		first * SectorSize);
+    }
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Revert
+// 	Throw away the changes made to a persistent bitmap since it was
+//	last fetched or written back, by reading the changed sectors
+//	back in from the Nachos file.
+//
+//	"file" is the place the bitmap was last written to
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Revert(OpenFile *file)
+{
+    int size = numWords * sizeof(unsigned);
+
+    for (int i = 0; i < numSectors; i++) {
+	if (dirty[i]) {
+	    file->ReadAt((char *)map + i * SectorSize,
+		min((i + 1) * SectorSize, size) - i * SectorSize,
+		i * SectorSize);
+	    dirty[i] = FALSE;
+	}
+    }
+    Recount();
 }
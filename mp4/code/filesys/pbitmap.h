@@ -6,6 +6,10 @@
 //    when it is created, or it can be initialized later using
 //    the FetchFrom method
 //
+//    The bitmap remembers which of its sectors have been changed
+//    since it was last fetched or written back, so that WriteBack
+//    only has to write those.
+//
 // Copyright (c) 1992,1993,1995 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -16,6 +20,7 @@
 #include "copyright.h"
 #include "bitmap.h"
 #include "openfile.h"
+#include "disk.h"
 
 // The following class defines a persistent bitmap.  It inherits all
 // the behavior of a bitmap (see bitmap.h), adding the ability to
@@ -28,8 +33,24 @@ class PersistentBitmap : public Bitmap {
 
     ~PersistentBitmap(); 			// deallocate bitmap
 
+    void Mark(int which);		// Set/clear the "nth" bit, noting
+    void Clear(int which);		// that its sector must be written
+    int FindAndSet();			// Find a clear bit, and set it
+    int FindAndSetRun(int wanted, int *length);
+					// Find and set a run of clear bits
+
     void FetchFrom(OpenFile *file);     // read bitmap from the disk
-    void WriteBack(OpenFile *file); 	// write bitmap contents to disk 
+    void WriteBack(OpenFile *file); 	// write changed sectors of the
+					// bitmap to disk 
+    void Revert(OpenFile *file);	// undo the changes made since the
+					// last FetchFrom or WriteBack, by
+					// re-reading the changed sectors
+
+  private:
+    int numSectors;			// # of sectors the bitmap takes up
+    bool *dirty;			// which of them have been changed
+
+    void SetDirty(int which) { dirty[which / (SectorSize * BitsInByte)] = TRUE; }
 };
 
 #endif // PBITMAP_H
@@ -6,9 +6,22 @@
 //	the request completes).
 //
 //	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	pending requests.  Because the physical disk can only handle one
+//	operation at a time, requests that come while it is busy are
+//	queued, and the interrupt handler starts the next one.
+//
+//	Sectors are cached in memory, and writes are only made to disk
+//	when a buffer is replaced or the cache is flushed (see synchdisk.h).
+//	Nachos flushes the cache when it halts; writes still in the cache
+//	are lost if Nachos is killed.
+//
+//	The cache and the request queue are changed by the interrupt
+//	handler as well as by threads, so they are only changed with
+//	interrupts off.  A thread waits for a buffer, with its semaphore,
+//	while a request is reading or writing it; other threads can use
+//	the rest of the cache, and queue requests of their own, meanwhile.
+//	Since anything may have changed while a thread waited, it looks
+//	again for what it wants when it wakes up.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -16,6 +29,8 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "main.h"
+
 
 
 //----------------------------------------------------------------------
@@ -23,13 +38,50 @@
 // 	Initialize the synchronous interface to the physical disk, in turn
 //	initializing the physical disk.
 //
+//	"cacheSize" -- # of sectors to cache; 0 sends every request
+//		straight to the disk
+//	"diskPolicy" -- the order in which to start queued requests
+//	"mapDisk" -- map the disk's UNIX file into memory?
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk()
+SynchDisk::SynchDisk(int cacheSize, DiskPolicy diskPolicy, bool mapDisk)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
-    disk = new Disk(this);
+    int i;
+
+    disk = new Disk(this, mapDisk);
+    requests = new List<DiskRequest *>;
+    numActive = 0;
+    policy = diskPolicy;
+    headSector = 0;
+    ascending = TRUE;
+
+    ASSERT(cacheSize >= 0);
+    numBuffers = cacheSize;
+    buffers = new CacheBuffer[numBuffers];
+    for (numBuckets = 1; numBuckets < numBuffers; numBuckets *= 2)
+	;
+    hashTable = new int[numBuckets];
+    for (i = 0; i < numBuckets; i++)
+	hashTable[i] = -1;
+    hot.newest = hot.oldest = cold.newest = cold.oldest = -1;
+    hot.count = cold.count = 0;
+    coldTarget = max(1, numBuffers / 4);
+    numGhosts = numBuffers / 2;
+    ghosts = new int[max(1, numGhosts)];
+    ghostHead = ghostCount = 0;
+    numPrefetched = 0;
+    maxPrefetch = coldTarget / 2;	// so they're used before they
+					// reach the end of the cold queue
+    for (i = 0; i < numBuffers; i++) {	// all start out empty, and so
+	buffers[i].sector = -1;		// are the first to be replaced
+	buffers[i].dirty = FALSE;
+	buffers[i].busy = NULL;
+	buffers[i].waiters = 0;
+	buffers[i].ready = new Semaphore("cache buffer", 0);
+	buffers[i].prefetched = FALSE;
+	buffers[i].hashNext = -1;
+	Link(i, FALSE);
+    }
 }
 
 //----------------------------------------------------------------------
@@ -40,9 +92,13 @@ SynchDisk::SynchDisk()
 
 SynchDisk::~SynchDisk()
 {
+    for (int i = 0; i < numBuffers; i++)
+	delete buffers[i].ready;
+    delete [] buffers;
+    delete [] hashTable;
+    delete [] ghosts;
+    delete requests;
     delete disk;
-    delete lock;
-    delete semaphore;
 }
 
 //----------------------------------------------------------------------
@@ -57,10 +113,7 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    ReadSectors(sectorNumber, 1, data);
 }
 
 //----------------------------------------------------------------------
@@ -75,20 +128,691 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    WriteSectors(sectorNumber, 1, data);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadSectors
+// 	Read a run of consecutive disk sectors into a buffer.  Return
+//	only after all of them have been read.
+//
+//	Reads are queued for as many of the missing sectors as there
+//	are buffers free before waiting for any of them, so that the
+//	disk can do them as one request.
+//
+//	"sectorNumber" -- the first disk sector to read
+//	"numSectors" -- how many sectors to read
+//	"data" -- the buffer to hold the contents of the disk sectors
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadSectors(int sectorNumber, int numSectors, char* data)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    int i, j, which;
+
+    if (numBuffers == 0) {
+	DiskIO(sectorNumber, numSectors, data, FALSE);
+	(void) kernel->interrupt->SetLevel(oldLevel);
+	return;
+    }
+    for (i = 0; i < numSectors; i = j) {
+	for (j = i; j < numSectors; j++) {
+	    if (Lookup(sectorNumber + j) != -1) {
+		kernel->stats->numCacheHits++;
+		continue;
+	    }
+	    which = Victim();
+	    if (buffers[which].busy != NULL || buffers[which].dirty)
+		break;
+	    kernel->stats->numCacheMisses++;
+	    Assign(which, sectorNumber + j);
+	    StartIO(which, FALSE);
+	}
+	if (j == i) {			// no buffer free; GetBuffer will
+	    kernel->stats->numCacheMisses++;	// make room for one
+	    j = i + 1;
+	}
+	for (; i < j; i++) {
+	    which = GetBuffer(sectorNumber + i, TRUE);
+	    memcpy(data + i * SectorSize, buffers[which].data, SectorSize);
+	}
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteSectors
+// 	Write a buffer into a run of consecutive disk sectors.  Return
+//	only after all of them have been written.
+//
+//	"sectorNumber" -- the first disk sector to be written
+//	"numSectors" -- how many sectors to write
+//	"data" -- the new contents of the disk sectors
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteSectors(int sectorNumber, int numSectors, char* data)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    int i, which;
+
+    if (numBuffers == 0) {
+	DiskIO(sectorNumber, numSectors, data, TRUE);
+    } else {
+	for (i = 0; i < numSectors; i++) {
+	    which = GetBuffer(sectorNumber + i, FALSE);
+	    memcpy(buffers[which].data, data + i * SectorSize, SectorSize);
+	    buffers[which].dirty = TRUE;
+	}
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Prefetch
+// 	Ask for a run of consecutive sectors to be read into the cache,
+//	and return without waiting for them.  Sectors already cached are
+//	skipped.  Stop early if too many sectors read ahead are still
+//	waiting to be used, since more would push them out of the cache;
+//	or if the buffer to be replaced would have to be written back
+//	first.  Return the number of sectors, from the start of the run,
+//	that are cached or on their way.
+//
+//	"sectorNumber" -- the first disk sector that will be wanted soon
+//	"numSectors" -- how many sectors are wanted
+//----------------------------------------------------------------------
+
+int
+SynchDisk::Prefetch(int sectorNumber, int numSectors)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    int i, which;
+
+    for (i = 0; i < numSectors; i++) {
+	if (Lookup(sectorNumber + i) != -1)
+	    continue;			// already there, or on its way
+	if (numPrefetched >= maxPrefetch)
+	    break;
+	which = Victim();
+	if (buffers[which].busy != NULL || buffers[which].dirty)
+	    break;
+	DEBUG(dbgDisk, "Reading ahead sector " << sectorNumber + i);
+	Assign(which, sectorNumber + i);
+	buffers[which].prefetched = TRUE;
+	numPrefetched++;
+	StartIO(which, FALSE);
+    }
+    StartDisk();
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    return i;
+}
+
+//----------------------------------------------------------------------
+// CompareSectors
+// 	Order buffers by the sector they hold, for qsort.
+//----------------------------------------------------------------------
+
+static int
+CompareSectors(const void *a, const void *b)
+{
+    return (*(CacheBuffer **) a)->sector - (*(CacheBuffer **) b)->sector;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Flush
+// 	Write every dirty buffer in the cache back to disk, and wait for
+//	all the requests in progress to finish.  The buffers stay cached.
+//	Then make sure the disk's UNIX file has everything written.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Flush()
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    CacheBuffer **dirty = new CacheBuffer *[numBuffers];
+    int i, numDirty = 0;
+
+    for (i = 0; i < numBuffers; i++) {
+	if (buffers[i].dirty) {
+	    dirty[numDirty++] = &buffers[i];
+	}
+    }
+    qsort(dirty, numDirty, sizeof(CacheBuffer *), CompareSectors);
+    for (i = 0; i < numDirty; i++) {
+	StartIO(dirty[i] - buffers, TRUE);
+    }
+    delete [] dirty;
+    for (i = 0; i < numBuffers; i++) {
+	while (buffers[i].busy != NULL)
+	    WaitFor(i);
+    }
+    disk->Sync();
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteBack
+// 	Write back a dirty buffer, so that it can be replaced, and wait
+//	for it.  If it is on the cold queue, the other dirty buffers there
+//	will soon be replaced too, so they are written along with it,
+//	queued in sector order.  We wait for all of them, rather than
+//	let our next read go in between each pair of writes, seeking
+//	back and forth.  Interrupts must be off.
+//
+//	"which" -- the buffer to be replaced
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteBack(int which)
+{
+    CacheBuffer **dirty = new CacheBuffer *[numBuffers];
+    int i, numDirty = 0;
+
+    if (buffers[which].hot) {
+	dirty[numDirty++] = &buffers[which];
+    } else {
+	for (i = cold.oldest; i != -1; i = buffers[i].newer) {
+	    if (buffers[i].dirty)
+		dirty[numDirty++] = &buffers[i];
+	}
+    }
+    qsort(dirty, numDirty, sizeof(CacheBuffer *), CompareSectors);
+    for (i = 0; i < numDirty; i++) {
+	StartIO(dirty[i] - buffers, TRUE);
+    }
+    for (i = 0; i < numDirty; i++) {
+	if (dirty[i]->busy != NULL)
+	    WaitFor(dirty[i] - buffers);
+    }
+    delete [] dirty;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::GetBuffer
+// 	Return the buffer for a sector, with no request in progress on
+//	it, replacing another sector if this one isn't cached.  Interrupts
+//	must be off.
+//
+//	"sectorNumber" -- the disk sector wanted
+//	"reading" -- if a buffer has to be replaced, read the sector
+//		into it?  If not, the caller is about to overwrite all of it.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::GetBuffer(int sectorNumber, bool reading)
+{
+    int which;
+
+    for (;;) {
+	which = Lookup(sectorNumber);
+	if (which != -1) {
+	    if (buffers[which].busy != NULL) {	// being read or written
+		WaitFor(which);
+		continue;
+	    }
+	    Touch(which);
+	    return which;
+	}
+	which = Victim();
+	if (buffers[which].busy != NULL) {	// being written back, say
+	    WaitFor(which);
+	} else if (buffers[which].dirty) {
+	    WriteBack(which);
+	} else {
+	    Assign(which, sectorNumber);
+	    if (!reading)
+		return which;
+	    StartIO(which, FALSE);
+	    WaitFor(which);		// then look it up again
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StartIO
+// 	Queue a request to read a buffer's sector into it, or write it
+//	out, without waiting for it.  The buffer is busy until the request
+//	is done.  The request isn't started until StartDisk is called, so
+//	that a batch of requests can be queued first.  Interrupts must
+//	be off.
+//
+//	"which" -- the buffer
+//	"writing" -- write it, or read it?
+//----------------------------------------------------------------------
+
+void
+SynchDisk::StartIO(int which, bool writing)
+{
+    DiskRequest *request = new DiskRequest;
+
+    ASSERT(buffers[which].busy == NULL);
+    request->sector = buffers[which].sector;
+    request->data = buffers[which].data;
+    request->writing = writing;
+    request->urgent = FALSE;
+    request->buffer = which;
+    request->done = NULL;
+    buffers[which].busy = request;
+    if (writing)
+	buffers[which].dirty = FALSE;	// nothing can change it until
+					// it has been written
+    Queue(request);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WaitFor
+// 	Wait for the request in progress on a buffer to be done.  If it
+//	hasn't been started, it now goes ahead of any that no thread is
+//	waiting for.  Interrupts must be off.
+//
+//	"which" -- the buffer
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WaitFor(int which)
+{
+    ASSERT(buffers[which].busy != NULL);
+    buffers[which].busy->urgent = TRUE;
+    StartDisk();
+    buffers[which].waiters++;
+    buffers[which].ready->P();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::DiskIO
+// 	Read or write a run of consecutive sectors on the raw disk,
+//	bypassing the cache, and wait for the requests to finish.
+//	Interrupts must be off.
+//
+//	"sectorNumber" -- the first disk sector to read or write
+//	"numSectors" -- how many sectors
+//	"data" -- where the contents of the sectors go, or come from
+//	"writing" -- write the sectors, or read them?
+//----------------------------------------------------------------------
+
+void
+SynchDisk::DiskIO(int sectorNumber, int numSectors, char* data, bool writing)
+{
+    Semaphore done("synch disk", 0);
+    DiskRequest *request = new DiskRequest[numSectors];
+    int i;
+
+    for (i = 0; i < numSectors; i++) {
+	request[i].sector = sectorNumber + i;
+	request[i].data = data + i * SectorSize;
+	request[i].writing = writing;
+	request[i].urgent = TRUE;
+	request[i].buffer = -1;
+	request[i].done = &done;
+	Queue(&request[i]);
+    }
+    StartDisk();
+    for (i = 0; i < numSectors; i++)
+	done.P();			// wait for interrupt
+    delete [] request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Queue
+// 	Add a request to the queue.  Interrupts must be off.
+//
+//	"request" -- the request
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Queue(DiskRequest *request)
+{
+    requests->Append(request);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StartDisk
+// 	Start the next request queued, if the disk is free.  Interrupts
+//	must be off.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::StartDisk()
+{
+    if (numActive == 0 && !requests->IsEmpty())
+	StartNext();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StartNext
+// 	Start the request that comes next, by the scheduling policy,
+//	along with any queued requests for the sectors after it, to be
+//	done as one disk request.  The disk must be free, and the queue
+//	not empty.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::StartNext()
+{
+    char *data[MaxTransfer];
+    DiskRequest *next;
+    int i;
+
+    ASSERT(numActive == 0);
+    active[numActive++] = Choose();
+    while (numActive < MaxTransfer
+	    && (next = TakeAdjacent(active[numActive - 1])) != NULL) {
+	active[numActive++] = next;
+    }
+    for (i = 0; i < numActive; i++)
+	data[i] = active[i]->data;
+    headSector = active[numActive - 1]->sector;
+    if (active[0]->writing)
+	disk->WriteRequest(active[0]->sector, numActive, data);
+    else
+	disk->ReadRequest(active[0]->sector, numActive, data);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::TakeAdjacent
+// 	Take the queued request for the sector after a given request's
+//	off the queue, if there is one going the same way.
+//
+//	"request" -- the request to follow
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::TakeAdjacent(DiskRequest *request)
+{
+    ListIterator<DiskRequest *> iter(requests);
+    DiskRequest *next;
+
+    if (request->sector + 1 >= NumSectors)
+	return NULL;
+    for (; !iter.IsDone(); iter.Next()) {
+	next = iter.Item();
+	if (next->sector == request->sector + 1
+		&& next->writing == request->writing) {
+	    requests->Remove(next);
+	    return next;
+	}
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Choose
+// 	Take the request that should be started next off the queue.
+//	Only requests that a thread is waiting for are considered, if
+//	there are any.  Among those, pick the one with the lowest cost
+//	under the scheduling policy; if there is a tie, the one that has
+//	been waiting longest.
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::Choose()
+{
+    ListIterator<DiskRequest *> find(requests);
+    ListIterator<DiskRequest *> iter(requests);
+    DiskRequest *best = NULL, *request;
+    int cost, bestCost = 0;
+    bool urgent = FALSE;
+
+    for (; !find.IsDone(); find.Next())
+	urgent = urgent || find.Item()->urgent;
+
+    for (; !iter.IsDone(); iter.Next()) {
+	request = iter.Item();
+	if (urgent && !request->urgent)
+	    continue;
+	switch (policy) {
+	  case DiskFcfs:
+	    cost = 0;
+	    break;
+	  case DiskSstf:
+	    cost = disk->ComputeLatency(request->sector, request->writing);
+	    break;
+	  case DiskScan:		// behind the head costs more than
+					// anything ahead of it
+	    cost = request->sector - headSector;
+	    if (!ascending)
+		cost = -cost;
+	    if (cost < 0)
+		cost = NumSectors - cost;
+	    break;
+	  case DiskCLook:		// below the head, go back to the
+					// lowest one
+	    cost = request->sector - headSector;
+	    if (cost < 0)
+		cost = NumSectors + request->sector;
+	    break;
+	}
+	if (best == NULL || cost < bestCost) {
+	    best = request;
+	    bestCost = cost;
+	}
+    }
+    ASSERT(best != NULL);
+    if (policy == DiskScan && bestCost >= NumSectors)
+	ascending = !ascending;		// nothing left ahead; turn round
+    requests->Remove(best);
+    return best;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Lookup
+// 	Return the buffer holding a sector, or -1 if it isn't cached.
+//
+//	"sectorNumber" -- the disk sector to look for
+//----------------------------------------------------------------------
+
+int
+SynchDisk::Lookup(int sectorNumber)
+{
+    int which = hashTable[sectorNumber & (numBuckets - 1)];
+
+    while (which != -1 && buffers[which].sector != sectorNumber)
+	which = buffers[which].hashNext;
+    return which;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Victim
+// 	Return the buffer to replace next: an empty one if there is one
+//	(they are the oldest on the cold queue), otherwise the oldest on
+//	the cold queue if that queue is over its share of the cache, and
+//	otherwise the least recently used on the hot queue.  It may still
+//	have a request in progress.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::Victim()
+{
+    int which = cold.oldest;
+
+    if (which == -1 || (buffers[which].sector != -1
+			&& cold.count <= coldTarget && hot.count > 0)) {
+	which = hot.oldest;
+    }
+    ASSERT(which != -1);
+    return which;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Assign
+// 	Reuse a clean buffer, with no request in progress, for a sector
+//	that isn't cached.  The buffer goes on the newest end of the hot
+//	queue if the sector was replaced from the cold queue not long ago,
+//	and of the cold queue otherwise.  The caller fills in the contents.
+//	Interrupts must be off.
+//
+//	"which" -- the buffer, from Victim
+//	"sectorNumber" -- the disk sector the buffer is now for
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Assign(int which, int sectorNumber)
+{
+    CacheBuffer *buf = &buffers[which];
+    int *link;
+
+    ASSERT(buf->busy == NULL && !buf->dirty);
+    if (buf->prefetched)		// read ahead, and never used
+	numPrefetched--;
+    if (buf->sector != -1) {
+	DEBUG(dbgDisk, "Cache replacing sector " << buf->sector);
+	if (!buf->hot) {
+	    AddGhost(buf->sector);
+	}
+	link = &hashTable[buf->sector & (numBuckets - 1)];
+	while (*link != which)		// take it out of its hash bucket
+	    link = &buffers[*link].hashNext;
+	*link = buf->hashNext;
+    }
+    buf->sector = sectorNumber;
+    buf->prefetched = FALSE;
+    buf->hashNext = hashTable[sectorNumber & (numBuckets - 1)];
+    hashTable[sectorNumber & (numBuckets - 1)] = which;
+    Unlink(which);
+    Link(which, TakeGhost(sectorNumber));
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::AddGhost
+// 	Remember that a sector has been replaced from the cold queue,
+//	forgetting the oldest one remembered if there are too many.
+//
+//	"sectorNumber" -- the disk sector replaced
+//----------------------------------------------------------------------
+
+void
+SynchDisk::AddGhost(int sectorNumber)
+{
+    if (numGhosts == 0)
+	return;
+    if (ghostCount == numGhosts) {
+	ghostHead = (ghostHead + 1) % numGhosts;
+	ghostCount--;
+    }
+    ghosts[(ghostHead + ghostCount) % numGhosts] = sectorNumber;
+    ghostCount++;
 }
 
+//----------------------------------------------------------------------
+// SynchDisk::TakeGhost
+// 	Return TRUE if a sector was replaced from the cold queue recently
+//	enough to be remembered, and forget it.
+//
+//	"sectorNumber" -- the disk sector being read back in
+//----------------------------------------------------------------------
+
+bool
+SynchDisk::TakeGhost(int sectorNumber)
+{
+    for (int i = 0; i < ghostCount; i++) {
+	int *ghost = &ghosts[(ghostHead + i) % numGhosts];
+
+	if (*ghost == sectorNumber) {
+	    *ghost = -1;
+	    return TRUE;
+	}
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Touch
+// 	Record a use of a cached sector.  A buffer on the hot queue
+//	becomes the most recently used one; the cold queue is kept in
+//	the order the sectors came in, so nothing changes there.
+//
+//	"which" -- the buffer used
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Touch(int which)
+{
+    if (buffers[which].prefetched) {	// it was wanted after all
+	buffers[which].prefetched = FALSE;
+	numPrefetched--;
+    }
+    if (buffers[which].hot) {
+	Unlink(which);
+	Link(which, TRUE);
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Unlink
+// 	Take a buffer off the queue it is on.
+//
+//	"which" -- the buffer
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Unlink(int which)
+{
+    CacheBuffer *buf = &buffers[which];
+    CacheQueue *queue = buf->hot ? &hot : &cold;
+
+    if (buf->newer != -1)
+	buffers[buf->newer].older = buf->older;
+    else
+	queue->newest = buf->older;
+    if (buf->older != -1)
+	buffers[buf->older].newer = buf->newer;
+    else
+	queue->oldest = buf->newer;
+    queue->count--;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Link
+// 	Put a buffer on the newest end of a queue.
+//
+//	"which" -- the buffer
+//	"toHot" -- put it on the hot queue?  Otherwise, the cold queue.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Link(int which, bool toHot)
+{
+    CacheBuffer *buf = &buffers[which];
+    CacheQueue *queue = toHot ? &hot : &cold;
+
+    buf->hot = toHot;
+    buf->newer = -1;
+    buf->older = queue->newest;
+    if (queue->newest != -1)
+	buffers[queue->newest].newer = which;
+    else
+	queue->oldest = which;
+    queue->newest = which;
+    queue->count++;
+}
+
+
 //----------------------------------------------------------------------
 // SynchDisk::CallBack
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// 	Disk interrupt handler.  Wake up the threads waiting for the
+//	sectors just read or written, and start the next request queued,
+//	if any.
 //----------------------------------------------------------------------
 
 void
 SynchDisk::CallBack()
 { 
-    semaphore->V();
+    DiskRequest *request;
+    CacheBuffer *buf;
+
+    for (int i = 0; i < numActive; i++) {
+	request = active[i];
+	if (request->buffer != -1) {
+	    buf = &buffers[request->buffer];
+	    buf->busy = NULL;
+	    for (; buf->waiters > 0; buf->waiters--)
+		buf->ready->V();
+	    delete request;
+	} else {
+	    request->done->V();
+	}
+    }
+    numActive = 0;
+    StartDisk();
 }
@@ -13,6 +13,7 @@
 
 #include "disk.h"
 #include "synch.h"
+#include "list.h"
 #include "callback.h"
 
 // The following class defines a "synchronous" disk abstraction.
@@ -25,31 +26,177 @@
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
 // returning.
+//
+// Requests from different threads can be outstanding at once.  Those
+// the disk can't start yet wait in a queue, and when the disk finishes
+// a request, the next one is chosen by the disk scheduling policy
+// (see DiskPolicy).  Queued requests for the sectors following it are
+// started along with it, as a single request for the whole run, so a
+// run of sectors costs one disk request and one interrupt, rather than
+// one for each sector.
+//
+// The synchronous disk also keeps a cache of recently used sectors in
+// memory, so that the sectors the file system uses over and over --
+// directories, file headers, the free map -- are only read once.
+// Writes only go as far as the cache; a modified ("dirty") buffer is
+// written to disk when it is replaced, or when Flush is called.
+//
+// Buffers are found through a hash table on the sector number.  The
+// buffers are kept on one of two queues, as in the "2Q" scheme: a
+// sector comes into the cache on the "cold" queue, in FIFO order, and
+// stays there however often it is used -- a sector is often used
+// several times in a row (a file read in small pieces, say), which
+// says little about whether it will be wanted again later.  The
+// sectors pushed off the cold queue are remembered for a while, and
+// if one of them is read again, it goes on the "hot" queue, kept in
+// LRU order.  The cold queue is only a quarter of the cache, so
+// reading through a large file once doesn't push everything else out.
+//
+// Sectors can also be read into the cache ahead of time, with Prefetch.
+// Prefetch only queues the request, and returns without waiting.
+
+const int DefaultCacheSize = 64;	// # of sectors cached, unless the
+					// -bc flag says otherwise
+const int MaxTransfer = SectorsPerTrack;	// most sectors in one disk
+					// request
+
+// The order in which queued disk requests are started.  Requests that
+// a thread is waiting for always go before sectors being read ahead.
+
+enum DiskPolicy { DiskFcfs,		// in the order they were made
+		  DiskSstf,		// the one the disk can get to
+					// soonest, after seek and rotation
+		  DiskScan,		// the nearest one in the direction
+					// the head is moving, turning round
+					// when there are no more
+		  DiskCLook		// the nearest one at or above the
+					// head; when there are no more, back
+					// to the lowest one
+};
+
+class DiskRequest {
+  public:
+    int sector;				// the disk sector
+    char *data;				// where the data goes, or comes from
+    bool writing;			// write, or read?
+    bool urgent;			// is a thread waiting for it?
+    int buffer;				// the cache buffer it is for, or -1
+    Semaphore *done;			// if not for a buffer, V'ed when the
+					// request is finished
+};
+
+class CacheBuffer {
+  public:
+    int sector;				// the disk sector held, or -1
+    bool dirty;				// modified since it was last
+					// written to disk?
+    bool hot;				// on the hot queue, or the cold one?
+    DiskRequest *busy;			// the request reading or writing
+					// the buffer, or NULL
+    int waiters;			// # of threads waiting for it
+    Semaphore *ready;			// V'ed for each, when it is done
+    bool prefetched;			// read ahead, and not used since?
+    int hashNext;			// next buffer in the same hash
+					// bucket, or -1
+    int newer, older;			// neighbours on its queue, or -1
+    char data[SectorSize];		// the contents of the sector
+};
+
+class CacheQueue {
+  public:
+    int newest, oldest;			// ends of the queue, or -1 if empty
+    int count;				// # of buffers on the queue
+};
 
 class SynchDisk : public CallBackObj {
   public:
-    SynchDisk();    		        // Initialize a synchronous disk,
-					// by initializing the raw Disk.
+    SynchDisk(int cacheSize, DiskPolicy diskPolicy, bool mapDisk);
+					// Initialize a synchronous disk,
+					// by initializing the raw Disk, with
+					// "cacheSize" sectors of cache
     ~SynchDisk();			// De-allocate the synch disk data
-    
+
     void ReadSector(int sectorNumber, char* data);
     					// Read/write a disk sector, returning
     					// only once the data is actually read 
-					// or written.  These call
-    					// Disk::ReadRequest/WriteRequest and
-					// then wait until the request is done.
+					// or written (to the cache, if there
+					// is one).  A miss queues a request
+					// for the disk, and then waits until
+					// the request is done.
     void WriteSector(int sectorNumber, char* data);
-    
+    void ReadSectors(int sectorNumber, int numSectors, char* data);
+    					// Read/write a run of consecutive
+					// sectors, as few disk requests as
+					// the cache allows
+    void WriteSectors(int sectorNumber, int numSectors, char* data);
+
+    int Prefetch(int sectorNumber, int numSectors);
+					// Start reading a run of sectors into
+					// the cache, without waiting for
+					// them; return how many there was
+					// room for
+
+    void Flush();			// Write every dirty buffer to disk,
+					// and bring the disk file up to date
+
     void CallBack();			// Called by the disk device interrupt
 					// handler, to signal that the
 					// current disk operation is complete.
 
   private:
     Disk *disk;		  		// Raw disk device
-    Semaphore *semaphore; 		// To synchronize requesting thread 
-					// with the interrupt handler
-    Lock *lock;		  		// Only one read/write request
-					// can be sent to the disk at a time
+    List<DiskRequest *> *requests;	// requests waiting for the disk
+    DiskRequest *active[MaxTransfer];	// the run of requests the disk
+    int numActive;			// is doing, and its length; 0 if
+					// the disk is free
+    DiskPolicy policy;			// how to choose the next request
+    int headSector;			// last sector of the run started
+    bool ascending;			// is SCAN moving up the disk?
+
+    void Queue(DiskRequest *request);	// Add a request to the queue
+    void StartDisk();			// Start the next request queued,
+					// if the disk is free
+    void StartNext();			// Start the next run of requests
+    DiskRequest *Choose();		// Take the next request to start
+					// off the queue
+    DiskRequest *TakeAdjacent(DiskRequest *request);
+					// Take a request for the next sector
+					// off the queue, if there is one
+    void DiskIO(int sectorNumber, int numSectors, char* data,
+			bool writing);	// Do a run of requests, uncached
+    void StartIO(int which, bool writing);
+					// Queue a request for a buffer
+    void WaitFor(int which);		// Wait for a buffer's request
+    void WriteBack(int which);		// Write dirty buffers to disk
+
+    int numBuffers;			// # of sectors the cache holds
+    CacheBuffer *buffers;
+    int numBuckets;			// size of hash table; a power of 2
+    int *hashTable;			// first buffer in each bucket, or -1
+    CacheQueue hot, cold;		// the two replacement queues
+    int coldTarget;			// most buffers the cold queue keeps
+					// when the hot queue wants more
+    int *ghosts;			// sectors recently replaced from the
+					// cold queue, a circular queue; -1
+					// for an entry no longer wanted
+    int numGhosts;			// size of "ghosts"
+    int ghostHead, ghostCount;		// oldest entry, and # of entries
+    int numPrefetched;			// # of buffers read ahead, not used
+    int maxPrefetch;			// most sectors to be read ahead and
+					// not yet used, at once
+
+    int GetBuffer(int sectorNumber, bool reading);
+					// Find or make the buffer for a sector
+    int Lookup(int sectorNumber);	// Which buffer holds a sector, or -1
+    int Victim();			// Which buffer to replace next
+    void Assign(int which, int sectorNumber);
+					// Reuse a buffer for a sector
+    void AddGhost(int sectorNumber);	// Remember a sector replaced
+    bool TakeGhost(int sectorNumber);	// Was a sector replaced lately?
+    void Touch(int which);		// Note that a buffer has been used
+    void Unlink(int which);		// Take a buffer off its queue
+    void Link(int which, bool toHot);	// Put a buffer on the newest end
+					// of a queue
 };
 
 #endif // SYNCHDISK_H
@@ -2,6 +2,12 @@
 //	Routines to manage a bitmap -- an array of bits each of which
 //	can be either on or off.  Represented as an array of integers.
 //
+//	To find a clear bit quickly, we keep a count of the clear bits,
+//	the first word that may have a clear bit in it, and a summary
+//	with one bit per word saying whether the word is full; then we
+//	only need to look at individual bits within a word known to have
+//	a clear one.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -10,6 +16,13 @@
 #include "debug.h"
 #include "bitmap.h"
 
+// Bits of a word that are part of the bitmap: all of them, except in
+// the last word, if numBits is not a multiple of BitsInWord.
+
+#define ValidBits(word) \
+    (((word) == numWords - 1 && numBits % BitsInWord != 0) \
+	? (1u << (numBits % BitsInWord)) - 1 : ~0u)
+
 //----------------------------------------------------------------------
 // BitMap::BitMap
 // 	Initialize a bitmap with "numItems" bits, so that every bit is clear.
@@ -28,11 +41,11 @@ Bitmap::Bitmap(int numItems)
     numWords = divRoundUp(numBits, BitsInWord);
     map = new unsigned int[numWords];
     for (i = 0; i < numWords; i++) {
-	map[i] = 0;		// initialize map to keep Purify happy
-    }
-    for (i = 0; i < numBits; i++) {
-        Clear(i);
+	map[i] = 0;		// every bit starts out clear
     }
+    numSummaryWords = divRoundUp(numWords, BitsInWord);
+    full = new unsigned int[numSummaryWords];
+    Recount();
 }
 
 //----------------------------------------------------------------------
@@ -43,6 +56,53 @@ Bitmap::Bitmap(int numItems)
 Bitmap::~Bitmap()
 { 
     delete [] map;
+    delete [] full;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::UpdateFull
+// 	Set or clear the summary bit for a word of the bitmap, depending
+//	on whether it has any clear bits left.
+//
+//	"word" is the index of the word that changed.
+//----------------------------------------------------------------------
+
+void
+Bitmap::UpdateFull(int word)
+{
+    unsigned int bit = 1u << (word % BitsInWord);
+
+    if ((map[word] & ValidBits(word)) == ValidBits(word)) {
+	full[word / BitsInWord] |= bit;
+    } else {
+	full[word / BitsInWord] &= ~bit;
+    }
+}
+
+//----------------------------------------------------------------------
+// Bitmap::Recount
+// 	Recompute the count of clear bits, and the summary of full words,
+//	from scratch.  Needed whenever the bits have been changed other
+//	than through Mark or Clear (for instance, read in from disk).
+//----------------------------------------------------------------------
+
+void
+Bitmap::Recount()
+{
+    int i;
+
+    numClear = 0;
+    firstFree = numWords;
+    for (i = 0; i < numSummaryWords; i++) {
+	full[i] = 0;
+    }
+    for (i = 0; i < numWords; i++) {
+	numClear += __builtin_popcount(~map[i] & ValidBits(i));
+	UpdateFull(i);
+	if (firstFree == numWords && (~map[i] & ValidBits(i)) != 0) {
+	    firstFree = i;
+	}
+    }
 }
 
 //----------------------------------------------------------------------
@@ -55,9 +115,16 @@ Bitmap::~Bitmap()
 void
 Bitmap::Mark(int which) 
 { 
+    int word = which / BitsInWord;
+    unsigned int bit = 1u << (which % BitsInWord);
+
     ASSERT(which >= 0 && which < numBits);
 
-    map[which / BitsInWord] |= 1 << (which % BitsInWord);
+    if ((map[word] & bit) == 0) {
+	map[word] |= bit;
+	numClear--;
+	UpdateFull(word);
+    }
 
     ASSERT(Test(which));
 }
@@ -72,9 +139,19 @@ Bitmap::Mark(int which)
 void 
 Bitmap::Clear(int which) 
 {
+    int word = which / BitsInWord;
+    unsigned int bit = 1u << (which % BitsInWord);
+
     ASSERT(which >= 0 && which < numBits);
 
-    map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
+    if ((map[word] & bit) != 0) {
+	map[word] &= ~bit;
+	numClear++;
+	full[word / BitsInWord] &= ~(1u << (word % BitsInWord));
+	if (word < firstFree) {
+	    firstFree = word;
+	}
+    }
 
     ASSERT(!Test(which));
 }
@@ -91,7 +168,7 @@ Bitmap::Test(int which) const
 {
     ASSERT(which >= 0 && which < numBits);
     
-    if (map[which / BitsInWord] & (1 << (which % BitsInWord))) {
+    if (map[which / BitsInWord] & (1u << (which % BitsInWord))) {
 	return TRUE;
     } else {
 	return FALSE;
@@ -105,37 +182,116 @@ Bitmap::Test(int which) const
 //	(In other words, find and allocate a bit.)
 //
 //	If no bits are clear, return -1.
+//
+//	Starting from the first word that might have a clear bit, we use
+//	the summary to skip over full words 32 at a time, then pick the
+//	lowest clear bit of the first word that isn't full.
 //----------------------------------------------------------------------
 
 int 
 Bitmap::FindAndSet() 
 {
-    for (int i = 0; i < numBits; i++) {
-	if (!Test(i)) {
-	    Mark(i);
-	    return i;
+    int s, word, which;
+    unsigned int notFull;
+
+    if (numClear == 0) {
+	return -1;
+    }
+    s = firstFree / BitsInWord;
+    notFull = ~full[s] & (~0u << (firstFree % BitsInWord));
+    while (notFull == 0) {
+	s++;
+	ASSERT(s < numSummaryWords);	// numClear says there's a clear bit
+	notFull = ~full[s];
+    }
+    word = s * BitsInWord + __builtin_ctz(notFull);
+    firstFree = word;
+    which = word * BitsInWord + __builtin_ctz(~map[word]);
+    Mark(which);
+    return which;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::NextClear/NextSet
+// 	Return the number of the first clear (or set) bit, starting at
+//	"which"; if there is none, return -1 (or numBits).
+//----------------------------------------------------------------------
+
+int
+Bitmap::NextClear(int which) const
+{
+    int word = which / BitsInWord;
+    unsigned int bits;
+
+    if (which >= numBits) {
+	return -1;
+    }
+    bits = ~map[word] & ValidBits(word) & (~0u << (which % BitsInWord));
+    while (bits == 0) {
+	if (++word >= numWords) {
+	    return -1;
 	}
+	bits = ~map[word] & ValidBits(word);
     }
-    return -1;
+    return word * BitsInWord + __builtin_ctz(bits);
+}
+
+int
+Bitmap::NextSet(int which) const
+{
+    int word = which / BitsInWord;
+    unsigned int bits;
+
+    if (which >= numBits) {
+	return numBits;
+    }
+    bits = map[word] & (~0u << (which % BitsInWord));
+    while (bits == 0) {
+	if (++word >= numWords) {
+	    return numBits;
+	}
+	bits = map[word];
+    }
+    return min(word * BitsInWord + __builtin_ctz(bits), numBits);
 }
 
 //----------------------------------------------------------------------
-// Bitmap::NumClear
-// 	Return the number of clear bits in the bitmap.
-//	(In other words, how many bits are unallocated?)
+// Bitmap::FindAndSetRun
+// 	Find the first run of "wanted" clear bits in a row, and set them.
+//	If there is no run that long, use the longest run of clear bits
+//	instead.  Used to allocate disk sectors in contiguous pieces.
+//
+//	Return the first bit of the run, and set *length to the number
+//	of bits in it.  If no bits are clear, return -1.
+//
+//	"wanted" is the length of run we would like.
+//	"length" is where to return the length of run we got.
 //----------------------------------------------------------------------
 
-int 
-Bitmap::NumClear() const
+int
+Bitmap::FindAndSetRun(int wanted, int *length)
 {
-    int count = 0;
+    int start, end, best = -1, bestLength = 0;
 
-    for (int i = 0; i < numBits; i++) {
-	if (!Test(i)) {
-	    count++;
+    ASSERT(wanted > 0);
+    for (start = NextClear(firstFree * BitsInWord); start >= 0;
+					start = NextClear(end)) {
+	end = NextSet(start);
+	if (end - start >= wanted) {
+	    best = start;
+	    bestLength = wanted;
+	    break;
+	}
+	if (end - start > bestLength) {
+	    best = start;
+	    bestLength = end - start;
 	}
     }
-    return count;
+    for (int i = best; i < best + bestLength; i++) {
+	Mark(i);
+    }
+    *length = bestLength;
+    return best;
 }
 
 //----------------------------------------------------------------------
@@ -4,6 +4,9 @@
 //
 //	Represented as an array of unsigned integers, on which we do
 //	modulo arithmetic to find the bit we are interested in.
+//	Searches look at a whole word at a time; to skip quickly over
+//	long stretches of set bits, a second, smaller bitmap records
+//	which words are full.
 //
 //	The bitmap can be parameterized with with the number of bits being 
 //	managed.
@@ -42,7 +45,14 @@ class Bitmap {
     int FindAndSet();         // Return the # of a clear bit, and as a side
 				// effect, set the bit. 
 				// If no bits are clear, return -1.
-    int NumClear() const;	// Return the number of clear bits
+    int FindAndSetRun(int wanted, int *length);
+				// Find "wanted" clear bits in a row (or, if
+				// there is no such run, the longest run of
+				// clear bits there is) and set them.  Return
+				// the first one, and the number set in
+				// *length.  If no bits are clear, return -1.
+    int NumClear() const { return numClear; }
+				// Return the number of clear bits
 
     void Print() const;		// Print contents of bitmap
     void SelfTest();		// Test whether bitmap is working
@@ -54,6 +64,22 @@ class Bitmap {
 				//  multiple of the number of bits in
 				//  a word)
     unsigned int *map;		// bit storage
+
+    void Recount();		// Recompute the fields below from "map";
+				// call after changing "map" directly
+
+  private:
+    int numClear;		// number of clear bits
+    int firstFree;		// no word before this one has a clear bit
+    int numSummaryWords;	// number of words in "full"
+    unsigned int *full;		// bit i set if map[i] has no clear bits
+
+    void UpdateFull(int word);	// Bring "full" up to date for one word
+    int NextClear(int which) const;
+				// First clear bit at or after "which", or -1
+    int NextSet(int which) const;
+				// First set bit at or after "which", or
+				// numBits
 };
 
 #endif // BITMAP_H
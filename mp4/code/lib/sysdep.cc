@@ -50,6 +50,8 @@
 extern "C" {
 #include <signal.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 
 #ifndef NO_MPROT 
 #include <sys/mman.h>
@@ -367,6 +369,87 @@ WriteFile(int fd, char *buffer, int nBytes)
     ASSERT(retVal == nBytes);
 }
 
+//----------------------------------------------------------------------
+// ReadVector/WriteVector
+// 	Read or write "count" pieces of "size" bytes each, kept in the
+//	buffers "buffers[0]", "buffers[1]", ..., that lie one after another
+//	in an open file starting at "offset".  This takes one system call,
+//	instead of a seek and a read or write for each piece.  Abort if
+//	it fails.
+//----------------------------------------------------------------------
+
+void
+ReadVector(int fd, int offset, char **buffers, int count, int size)
+{
+    struct iovec *iov = new struct iovec[count];
+    int retVal;
+
+    for (int i = 0; i < count; i++) {
+	iov[i].iov_base = buffers[i];
+	iov[i].iov_len = size;
+    }
+    retVal = preadv(fd, iov, count, offset);
+    ASSERT(retVal == count * size);
+    delete [] iov;
+}
+
+void
+WriteVector(int fd, int offset, char **buffers, int count, int size)
+{
+    struct iovec *iov = new struct iovec[count];
+    int retVal;
+
+    for (int i = 0; i < count; i++) {
+	iov[i].iov_base = buffers[i];
+	iov[i].iov_len = size;
+    }
+    retVal = pwritev(fd, iov, count, offset);
+    ASSERT(retVal == count * size);
+    delete [] iov;
+}
+
+//----------------------------------------------------------------------
+// MapFile
+// 	Map the first "size" bytes of an open file into memory, so that
+//	loads and stores to the memory read and write the file, with no
+//	system calls.  Abort on error.
+//----------------------------------------------------------------------
+
+char *
+MapFile(int fd, int size)
+{
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    ASSERT(addr != MAP_FAILED);
+    return (char *) addr;
+}
+
+//----------------------------------------------------------------------
+// SyncMappedFile
+// 	Wait until everything stored to a mapped file has been written
+//	to the file.  Abort on error.
+//----------------------------------------------------------------------
+
+void
+SyncMappedFile(char *addr, int size)
+{
+    int retVal = msync(addr, size, MS_SYNC);
+    ASSERT(retVal == 0);
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+// 	Undo MapFile.  Anything stored to the memory still reaches the
+//	file.
+//----------------------------------------------------------------------
+
+void
+UnmapFile(char *addr, int size)
+{
+    int retVal = munmap(addr, size);
+    ASSERT(retVal == 0);
+}
+
 //----------------------------------------------------------------------
 // Lseek
 // 	Change the location within an open file.  Abort on error.
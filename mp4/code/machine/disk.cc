@@ -35,9 +35,11 @@ const int DiskSize = (MagicSize + (NumSectors * SectorSize));
 // 	ok to treat it as Nachos disk storage.
 //
 //	"toCall" -- object to call when disk read/write request completes
+//	"mapFile" -- if TRUE, map the UNIX file into memory, and move
+//		sectors to and from it with memcpy rather than system calls
 //----------------------------------------------------------------------
 
-Disk::Disk(CallBackObj *toCall)
+Disk::Disk(CallBackObj *toCall, bool mapFile)
 {
     int magicNum;
     int tmp = 0;
@@ -61,6 +63,7 @@ Disk::Disk(CallBackObj *toCall)
         Lseek(fileno, DiskSize - sizeof(int), 0);	
 	WriteFile(fileno, (char *)&tmp, sizeof(int));  
     }
+    mapped = mapFile ? MapFile(fileno, DiskSize) : NULL;
     active = FALSE;
 }
 
@@ -72,9 +75,25 @@ Disk::Disk(CallBackObj *toCall)
 
 Disk::~Disk()
 {
+    if (mapped != NULL)
+	UnmapFile(mapped, DiskSize);
     Close(fileno);
 }
 
+//----------------------------------------------------------------------
+// Disk::Sync()
+// 	Make sure every sector written so far has reached the UNIX file.
+//	Only needed if the file is mapped; otherwise each write goes
+//	straight to the file.
+//----------------------------------------------------------------------
+
+void
+Disk::Sync()
+{
+    if (mapped != NULL)
+	SyncMappedFile(mapped, DiskSize);
+}
+
 //----------------------------------------------------------------------
 // Disk::PrintSector()
 // 	Dump the data in a disk read/write request, for debugging.
@@ -113,39 +132,81 @@ PrintSector (bool writing, int sector, char *data)
 void
 Disk::ReadRequest(int sectorNumber, char* data)
 {
-    int ticks = ComputeLatency(sectorNumber, FALSE);
+    ReadRequest(sectorNumber, 1, &data);
+}
+
+void
+Disk::WriteRequest(int sectorNumber, char* data)
+{
+    WriteRequest(sectorNumber, 1, &data);
+}
+
+//----------------------------------------------------------------------
+// Disk::ReadRequest/WriteRequest
+// 	Simulate a request to read/write a run of consecutive disk
+//	sectors.  The whole run is transferred to or from the UNIX file
+//	with one system call, and there is one interrupt, when the last
+//	sector is done.
+//
+//	"sectorNumber" -- the first disk sector to read/write
+//	"numSectors" -- the number of sectors in the run
+//	"data" -- the buffers for each sector of the run, in order
+//----------------------------------------------------------------------
+
+void
+Disk::ReadRequest(int sectorNumber, int numSectors, char** data)
+{
+    int ticks = ComputeLatency(sectorNumber, numSectors, FALSE);
 
     ASSERT(!active);				// only one request at a time
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((sectorNumber >= 0) && (numSectors > 0)
+		&& (sectorNumber + numSectors <= NumSectors));
     
-    DEBUG(dbgDisk, "Reading from sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
-    if (debug->IsEnabled('d'))
-	PrintSector(FALSE, sectorNumber, data);
+    DEBUG(dbgDisk, "Reading " << numSectors << " sectors from sector " << sectorNumber);
+    if (mapped != NULL) {
+	for (int i = 0; i < numSectors; i++)
+	    memcpy(data[i], mapped + SectorSize * (sectorNumber + i) + MagicSize,
+			SectorSize);
+    } else {
+	ReadVector(fileno, SectorSize * sectorNumber + MagicSize, data,
+		numSectors, SectorSize);
+    }
+    if (debug->IsEnabled('d')) {
+	for (int i = 0; i < numSectors; i++)
+	    PrintSector(FALSE, sectorNumber + i, data[i]);
+    }
     
     active = TRUE;
-    UpdateLast(sectorNumber);
+    UpdateLast(sectorNumber, numSectors, ticks);
     kernel->stats->numDiskReads++;
     kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
 
 void
-Disk::WriteRequest(int sectorNumber, char* data)
+Disk::WriteRequest(int sectorNumber, int numSectors, char** data)
 {
-    int ticks = ComputeLatency(sectorNumber, TRUE);
+    int ticks = ComputeLatency(sectorNumber, numSectors, TRUE);
 
     ASSERT(!active);
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((sectorNumber >= 0) && (numSectors > 0)
+		&& (sectorNumber + numSectors <= NumSectors));
     
-    DEBUG(dbgDisk, "Writing to sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
-    if (debug->IsEnabled('d'))
-	PrintSector(TRUE, sectorNumber, data);
+    DEBUG(dbgDisk, "Writing " << numSectors << " sectors to sector " << sectorNumber);
+    if (mapped != NULL) {
+	for (int i = 0; i < numSectors; i++)
+	    memcpy(mapped + SectorSize * (sectorNumber + i) + MagicSize, data[i],
+			SectorSize);
+    } else {
+	WriteVector(fileno, SectorSize * sectorNumber + MagicSize, data,
+		numSectors, SectorSize);
+    }
+    if (debug->IsEnabled('d')) {
+	for (int i = 0; i < numSectors; i++)
+	    PrintSector(TRUE, sectorNumber + i, data[i]);
+    }
     
     active = TRUE;
-    UpdateLast(sectorNumber);
+    UpdateLast(sectorNumber, numSectors, ticks);
     kernel->stats->numDiskWrites++;
     kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
@@ -249,20 +310,58 @@ Disk::ComputeLatency(int newSector, bool writing)
     return(seek + rotation + RotationTime);
 }
 
+//----------------------------------------------------------------------
+// Disk::ComputeLatency()
+// 	Return how long it will take to read/write a run of consecutive
+//	sectors, from the current position of the disk head.
+//
+//	After the first sector, each sector on the same track follows
+//	right behind the one before it, taking only the transfer time.
+//	Going on to the next track costs a one-track seek, and then the
+//	rotational delay until its first sector comes round.
+//----------------------------------------------------------------------
+
+int
+Disk::ComputeLatency(int newSector, int numSectors, bool writing)
+{
+    int ticks = ComputeLatency(newSector, writing);
+    int sector, when, rotation;
+
+    for (sector = newSector + 1; sector < newSector + numSectors; sector++) {
+	if (sector % SectorsPerTrack != 0) {
+	    ticks += RotationTime;
+	    continue;
+	}
+	when = kernel->stats->totalTicks + ticks + SeekTime;
+	rotation = (RotationTime - when % RotationTime) % RotationTime;
+	rotation += ModuloDiff(sector, (when + rotation) / RotationTime)
+			* RotationTime;
+	ticks += SeekTime + rotation + RotationTime;
+    }
+    return ticks;
+}
+
 //----------------------------------------------------------------------
 // Disk::UpdateLast
 //   	Keep track of the most recently requested sector.  So we can know
 //	what is in the track buffer.
+//
+//	"newSector", "numSectors" -- the run of sectors requested
+//	"ticks" -- how long the request takes
 //----------------------------------------------------------------------
 
 void
-Disk::UpdateLast(int newSector)
+Disk::UpdateLast(int newSector, int numSectors, int ticks)
 {
     int rotate;
     int seek = TimeToSeek(newSector, &rotate);
+    int last = newSector + numSectors - 1;
     
     if (seek != 0)
 	bufferInit = kernel->stats->totalTicks + seek + rotate;
-    lastSector = newSector;
+    if (last / SectorsPerTrack != newSector / SectorsPerTrack)
+	bufferInit = kernel->stats->totalTicks + ticks	// the run ends on
+	    - (last % SectorsPerTrack + 1) * RotationTime;  // a later track
+    lastSector = last;
     DEBUG(dbgDisk, "Updating last sector = " << lastSector << " , " << bufferInit);
 }
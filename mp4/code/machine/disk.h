@@ -34,6 +34,9 @@
 // and an interrupt is invoked later to signal that the operation completed.
 //
 // The physical disk is in fact simulated via operations on a UNIX file.
+// The file can be mapped into memory, so that sectors are copied to and
+// from it without a system call for each request; Sync then makes sure
+// the file is up to date.
 //
 // To make life a little more realistic, the simulated time for
 // each operation reflects a "track buffer" -- RAM to store the contents
@@ -56,9 +59,12 @@ const int NumSectors = (SectorsPerTrack * NumTracks);
 
 class Disk : public CallBackObj {
   public:
-    Disk(CallBackObj *toCall);          // Create a simulated disk.  
+    Disk(CallBackObj *toCall, bool mapFile);
+    					// Create a simulated disk.  
 					// Invoke toCall->CallBack() 
 					// when each request completes.
+					// Map the UNIX file into memory,
+					// if "mapFile".
     ~Disk();				// Deallocate the disk.
     
     void ReadRequest(int sectorNumber, char* data);
@@ -67,6 +73,11 @@ class Disk : public CallBackObj {
     					// the disk and return immediately.
     					// Only one request allowed at a time!
     void WriteRequest(int sectorNumber, char* data);
+    void ReadRequest(int sectorNumber, int numSectors, char** data);
+    					// Read/write a run of consecutive
+					// sectors as one request, sector
+					// sectorNumber + i to/from data[i]
+    void WriteRequest(int sectorNumber, int numSectors, char** data);
 
     void CallBack();			// Invoked when disk request 
 					// finishes. In turn calls, callWhenDone.
@@ -75,10 +86,16 @@ class Disk : public CallBackObj {
     					// Return how long a request to 
 					// newSector will take: 
 					// (seek + rotational delay + transfer)
+    int ComputeLatency(int newSector, int numSectors, bool writing);
+    					// The same, for a run of sectors
+
+    void Sync();			// Bring the UNIX file up to date
 
   private:
     int fileno;				// UNIX file number for simulated disk 
     char diskname[32];			// name of simulated disk's file
+    char *mapped;			// the file, mapped into memory; or
+					// NULL if it isn't
     CallBackObj *callWhenDone;		// Invoke when any disk request finishes
     bool active;     			// Is a disk operation in progress?
     int lastSector;			// The previous disk request 
@@ -87,7 +104,7 @@ class Disk : public CallBackObj {
 
     int TimeToSeek(int newSector, int *rotate); // time to get to the new track
     int ModuloDiff(int to, int from);        // # sectors between to and from
-    void UpdateLast(int newSector);
+    void UpdateLast(int newSector, int numSectors, int ticks);
 };
 
 #endif // DISK_H
@@ -23,6 +23,7 @@
 #include "copyright.h"
 #include "interrupt.h"
 #include "main.h"
+#include "synchdisk.h"
 
 // String definitions for debugging messages
 
@@ -242,6 +243,8 @@ Interrupt::Halt()
     cout << "This is halt\n";
     kernel->stats->Print();
 	*/
+	kernel->synchDisk->Flush();	// write back cached sectors while
+					// the disk can still be used
 	delete debug;
 	
     delete kernel;	// Never returns.
@@ -30,6 +30,9 @@ Kernel::Kernel(int argc, char **argv)
     debugUserProg = FALSE;
     consoleIn = NULL;          // default is stdin
     consoleOut = NULL;         // default is stdout
+    cacheSize = DefaultCacheSize;
+    diskPolicy = DiskCLook;
+    mapDisk = FALSE;
 #ifndef FILESYS_STUB
     formatFlag = FALSE;
 #endif
@@ -60,6 +63,28 @@ Kernel::Kernel(int argc, char **argv)
 	    	ASSERT(i + 1 < argc);
 	    	consoleOut = argv[i + 1];
 	    	i++;
+		} else if (strcmp(argv[i], "-bc") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	cacheSize = atoi(argv[i + 1]);
+	    	ASSERT(cacheSize >= 0);
+	    	i++;
+		} else if (strcmp(argv[i], "-ds") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	i++;
+	    	if (strcmp(argv[i], "fcfs") == 0) {
+	    	    diskPolicy = DiskFcfs;
+	    	} else if (strcmp(argv[i], "sstf") == 0) {
+	    	    diskPolicy = DiskSstf;
+	    	} else if (strcmp(argv[i], "scan") == 0) {
+	    	    diskPolicy = DiskScan;
+	    	} else if (strcmp(argv[i], "clook") == 0) {
+	    	    diskPolicy = DiskCLook;
+	    	} else {
+	    	    cout << "Unknown disk scheduling policy " << argv[i] << "\n";
+	    	    ASSERTNOTREACHED();
+	    	}
+		} else if (strcmp(argv[i], "-dm") == 0) {
+	    	mapDisk = TRUE;
 #ifndef FILESYS_STUB
 		} else if (strcmp(argv[i], "-f") == 0) {
 	    	formatFlag = TRUE;
@@ -76,6 +101,8 @@ Kernel::Kernel(int argc, char **argv)
             cout << "Partial usage: nachos [-rs randomSeed]\n";
 	   		cout << "Partial usage: nachos [-s]\n";
             cout << "Partial usage: nachos [-ci consoleIn] [-co consoleOut]\n";
+            cout << "Partial usage: nachos [-bc cacheSectors]\n";
+            cout << "Partial usage: nachos [-ds fcfs|sstf|scan|clook] [-dm]\n";
 #ifndef FILESYS_STUB
 	    	cout << "Partial usage: nachos [-nf]\n";
 #endif
@@ -109,7 +136,7 @@ Kernel::Initialize()
     machine = new Machine(debugUserProg);
     synchConsoleIn = new SynchConsoleInput(consoleIn); // input from stdin
     synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
-    synchDisk = new SynchDisk();    //
+    synchDisk = new SynchDisk(cacheSize, (DiskPolicy) diskPolicy, mapDisk);
 #ifdef FILESYS_STUB
     fileSystem = new FileSystem();
 #else
@@ -341,16 +368,31 @@ int Kernel::CreateFile(char *name, int size) {
     return fileSystem->Create(name, size);
 }
 OpenFileId Kernel::OpenFile(char *name) {
-    return fileSystem->OpenAFile(name);
+    ::OpenFile *file = fileSystem->OpenAFile(name);
+    OpenFileId id;
+
+    if (file == NULL) return -1;
+    id = currentThread->space->AddOpenFile(file);
+    if (id < 0) fileSystem->CloseAFile(file); // too many files open
+    return id;
 }
 int Kernel::WriteFile(char *buffer, int size, OpenFileId id) {
-    return fileSystem->currentOpenFile->Write(buffer, size);
+    ::OpenFile *file = currentThread->space->GetOpenFile(id);
+
+    if (file == NULL) return -1;
+    return file->Write(buffer, size);
 }
 int Kernel::ReadFile(char *buffer, int size, OpenFileId id) {
-    return fileSystem->currentOpenFile->Read(buffer, size);
+    ::OpenFile *file = currentThread->space->GetOpenFile(id);
+
+    if (file == NULL) return -1;
+    return file->Read(buffer, size);
 }
 int Kernel::CloseFile(OpenFileId id) {
-    return fileSystem->CloseAFile();
+    ::OpenFile *file = currentThread->space->RemoveOpenFile(id);
+
+    if (file == NULL) return -1;
+    return fileSystem->CloseAFile(file);
 }
 
 
@@ -93,6 +93,9 @@ class Kernel {
     double reliability;         // likelihood messages are dropped
     char *consoleIn;            // file to read console input from
     char *consoleOut;           // file to send console output to
+    int cacheSize;		// # of disk sectors to cache
+    int diskPolicy;		// DiskPolicy for the disk request queue
+    bool mapDisk;		// map the disk's UNIX file into memory?
 #ifndef FILESYS_STUB
     bool formatFlag;          // format the disk if this is true
 #endif
@@ -4,6 +4,7 @@
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
 //              -s -x <nachos file> -ci <consoleIn> -co <consoleOut>
+//              -bc <cache sectors> -ds <disk scheduling policy> -dm
 //              -f -cp <unix file> <nachos file>
 //              -p <nachos file> -r <nachos file> -l -D
 //              -n <network reliability> -m <machine id>
@@ -16,6 +17,11 @@
 //    -x runs a user program
 //    -ci specify file for console input (stdin is the default)
 //    -co specify file for console output (stdout is the default)
+//    -bc sets how many disk sectors are cached in memory (0 for none)
+//    -ds chooses the order queued disk requests are done in: fcfs,
+//	sstf (shortest seek and rotation first), scan, or clook (default)
+//    -dm maps the disk's UNIX file into memory, instead of reading and
+//	writing it with a system call for each request
 //    -n sets the network reliability
 //    -m sets this machine's host id (needed for the network)
 //    -K run a simple self test of kernel threads and synchronization
@@ -66,6 +66,8 @@ Thread::~Thread()
     ASSERT(this != kernel->currentThread);
     if (stack != NULL)
 	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+    if (space != NULL)		// closes the files the program left open
+	delete space;
 }
 
 //----------------------------------------------------------------------
@@ -20,6 +20,7 @@
 #include "addrspace.h"
 #include "machine.h"
 #include "noff.h"
+#include "syscall.h"
 
 //----------------------------------------------------------------------
 // SwapHeader
@@ -79,6 +80,10 @@ AddrSpace::AddrSpace()
     
     // zero out the entire address space
     bzero(kernel->machine->mainMemory, MemorySize);
+
+    for (int i = 0; i < MaxOpenFilesPerProcess; i++) {
+	openFiles[i] = NULL;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -88,7 +93,11 @@ AddrSpace::AddrSpace()
 
 AddrSpace::~AddrSpace()
 {
-   delete pageTable;
+   delete [] pageTable;
+   for (int i = 0; i < MaxOpenFilesPerProcess; i++) {
+	if (openFiles[i] != NULL)	// the program didn't close it
+	    kernel->fileSystem->CloseAFile(openFiles[i]);
+   }
 }
 
 
@@ -311,6 +320,57 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
     return NoException;
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::AddOpenFile
+// 	Give a file the program has opened the lowest free OpenFileId,
+//	and return it; or return -1 if the program has too many files
+//	open.  Ids 0 and 1 are the console's, and never given out.
+//
+//	"file" -- the open file
+//----------------------------------------------------------------------
 
+OpenFileId
+AddrSpace::AddOpenFile(OpenFile *file)
+{
+    for (int id = SysConsoleOutput + 1; id < MaxOpenFilesPerProcess; id++) {
+	if (openFiles[id] == NULL) {
+	    openFiles[id] = file;
+	    return id;
+	}
+    }
+    return -1;
+}
 
+//----------------------------------------------------------------------
+// AddrSpace::GetOpenFile
+// 	Return the open file with a given OpenFileId, or NULL if the id
+//	is not in use.
+//
+//	"id" -- the OpenFileId, as the program gave it
+//----------------------------------------------------------------------
 
+OpenFile *
+AddrSpace::GetOpenFile(OpenFileId id)
+{
+    if (id < 0 || id >= MaxOpenFilesPerProcess)
+	return NULL;
+    return openFiles[id];
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::RemoveOpenFile
+// 	Free an OpenFileId, returning the open file it was for, or NULL
+//	if the id is not in use.  The caller closes the file.
+//
+//	"id" -- the OpenFileId, as the program gave it
+//----------------------------------------------------------------------
+
+OpenFile *
+AddrSpace::RemoveOpenFile(OpenFileId id)
+{
+    OpenFile *file = GetOpenFile(id);
+
+    if (file != NULL)
+	openFiles[id] = NULL;
+    return file;
+}
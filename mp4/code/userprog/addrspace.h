@@ -17,6 +17,9 @@
 #include "filesys.h"
 
 #define UserStackSize		1024 	// increase this as necessary!
+#define MaxOpenFilesPerProcess	16	// most files a program can have
+					// open at once, counting the two
+					// ids of the console
 
 class AddrSpace {
   public:
@@ -39,11 +42,23 @@ class AddrSpace {
     // is 0 for Read, 1 for Write.
     ExceptionType Translate(unsigned int vaddr, unsigned int *paddr, int mode);
 
+    OpenFileId AddOpenFile(OpenFile *file);
+					// Give an open file an id, or
+					// return -1 if the table is full
+    OpenFile *GetOpenFile(OpenFileId id);
+					// The open file with an id, or NULL
+    OpenFile *RemoveOpenFile(OpenFileId id);
+					// Take an open file out of the table,
+					// returning it, or NULL
+
   private:
     TranslationEntry *pageTable;	// Assume linear page table translation
 					// for now!
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
+    OpenFile *openFiles[MaxOpenFilesPerProcess];
+					// the program's open files, by id;
+					// NULL if not in use
 
     void InitRegisters();		// Initialize user-level CPU registers,
 					// before jumping to user code